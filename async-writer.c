@@ -0,0 +1,430 @@
+#include "async-writer.h"
+#include "utils.h"
+#include "latency-calibration.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef MG_HAVE_LIBURING
+#include <liburing.h>
+#define URING_DEPTH 8
+#endif
+
+/**
+ * First row of a round in the legacy CSV: "value, count"
+ */
+static int csv_round_start(const char* line) {
+    const char* comma = strchr(line, ',');
+    return comma && comma[1] == ' ';
+}
+
+/**
+ * Every feature row is a round
+ */
+static int feature_round_start(const char* line) {
+    (void)line;
+    return 1;
+}
+
+/**
+ * Cut a text output back to its first `rounds` rounds; rounds start at the lines
+ * starts_round() accepts, after header_lines header lines. A missing file is fine
+ */
+static int trim_text_rounds(const char* path, size_t rounds, size_t header_lines, int (*starts_round)(const char*)) {
+    FILE* file = fopen(path, "r");
+    if (!file) return 1;
+    char* line = NULL;
+    size_t line_capacity = 0;
+    size_t line_no = 0, seen = 0;
+    long cut = -1;
+    for (;;) {
+        long start = ftell(file);
+        if (getline(&line, &line_capacity, file) < 0) break;
+        if (line_no++ < header_lines || !starts_round(line)) continue;
+        if (seen++ == rounds) {
+            cut = start;
+            break;
+        }
+    }
+    free(line);
+    fclose(file);
+    if (cut >= 0 && truncate(path, cut) != 0) {
+        perror("Failed to trim output file");
+        return 0;
+    }
+    return 1;
+}
+
+int open_sink(trace_sink_t* sink, const char* site, const cpu_config_t* config,
+              uint64_t interval_cycles, uint64_t probe_cycles, unsigned outputs, size_t rounds) {
+    if (!sink || !site) return 0;
+    memset(sink, 0, sizeof(trace_sink_t));
+    strncpy(sink->site, site, sizeof(sink->site) - 1);
+    sink->packed = (outputs & SINK_PACKED) != 0;
+    if ((outputs & SINK_EVICTIONS) && config->latency.calibrated) sink->latency = &config->latency;
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s.mgtrace", site);
+    if (!trace_open(&sink->trace, path, config, interval_cycles, probe_cycles, site)) return 0;
+    if (!trace_truncate(&sink->trace, rounds)) {
+        close_sink(sink);
+        return 0;
+    }
+
+    if (outputs & SINK_CSV) {
+        snprintf(path, sizeof(path), "%s.csv", site);
+        if (!trim_text_rounds(path, rounds, 0, csv_round_start)) {
+            close_sink(sink);
+            return 0;
+        }
+        sink->csv = fopen(path, "a");
+        if (!sink->csv) {
+            perror("Failed to open CSV file");
+            close_sink(sink);
+            return 0;
+        }
+    }
+    if (outputs & SINK_FEATURES) {
+        snprintf(path, sizeof(path), "%s.features.csv", site);
+        if (!trim_text_rounds(path, rounds, 1, feature_round_start)) {
+            close_sink(sink);
+            return 0;
+        }
+        sink->features = fopen(path, "a");
+        if (!sink->features) {
+            perror("Failed to open feature file");
+            close_sink(sink);
+            return 0;
+        }
+        if (ftell(sink->features) == 0) feature_write_header(sink->features);
+    }
+    return 1;
+}
+
+int close_sink(trace_sink_t* sink) {
+    if (!sink) return 0;
+    int ok = trace_close(&sink->trace);
+    if (sink->csv) {
+        fclose(sink->csv);
+        sink->csv = NULL;
+    }
+    if (sink->features) {
+        fclose(sink->features);
+        sink->features = NULL;
+    }
+    return ok;
+}
+
+/**
+ * Replace the sweep cycles of a written block by the evictions they stand for.
+ * Only the CSV and the dataset see the result, the trace keeps the cycles
+ */
+static void timings_to_evictions(const cache_latency_t* latency, trace_block_t* block) {
+    uint64_t* timings = (uint64_t*)trace_column(block, TRACE_COL_TIMINGS);
+    for (uint64_t i = 0; timings && i < block->num_samples; ++i) {
+        timings[i] = (uint64_t)(estimate_evictions(latency, timings[i]) + 0.5);
+    }
+}
+
+/**
+ * Same rows as write_timings_to_csv(), formatted on the writer thread
+ */
+static void write_block_csv(FILE* csv, const trace_block_t* block) {
+    const uint64_t* timings = trace_column(block, TRACE_COL_TIMINGS);
+    for (uint64_t i = 0; i < block->num_samples; ++i) {
+        if (i == 0) {
+            fprintf(csv, "%" PRIu64 ", %" PRIu64 "\n", timings[i], block->num_samples);
+        } else {
+            fprintf(csv, "%" PRIu64 ",\n", timings[i]);
+        }
+    }
+}
+
+#ifdef MG_HAVE_LIBURING
+static ssize_t uring_writev(struct io_uring* ring, int fd, const struct iovec* iov, int iovcnt, off_t offset) {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    if (!sqe) {
+        errno = EBUSY;
+        return -1;
+    }
+    io_uring_prep_writev(sqe, fd, iov, (unsigned)iovcnt, (uint64_t)offset);
+    int ret = io_uring_submit(ring);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    struct io_uring_cqe* cqe;
+    ret = io_uring_wait_cqe(ring, &cqe);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    ssize_t res = cqe->res;
+    io_uring_cqe_seen(ring, cqe);
+    if (res < 0) {
+        errno = (int)-res;
+        return -1;
+    }
+    return res;
+}
+#endif
+
+/**
+ * Vectored write of a whole batch at `offset`, resumed after short writes
+ */
+static int write_batch(async_writer_t* aw, int fd, struct iovec* iov, int iovcnt, uint64_t offset) {
+    (void)aw; // only consulted with io_uring
+    while (iovcnt > 0) {
+        ssize_t n;
+#ifdef MG_HAVE_LIBURING
+        if (aw->use_uring) {
+            n = uring_writev(aw->uring, fd, iov, iovcnt, (off_t)offset);
+        } else
+#endif
+        {
+            n = pwritev(fd, iov, iovcnt, (off_t)offset);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write trace batch");
+            return 0;
+        }
+        offset += (uint64_t)n;
+        // Skip what was written
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Packs buf->data into buf->packed. The raw block is kept for the CSV and the dataset
+ */
+static void pack_round(write_buf_t* buf) {
+    buf->packed_size = 0;
+    size_t bound = trace_packed_bound(buf->data);
+    if (bound > buf->packed_capacity) {
+        void* packed = realloc(buf->packed, bound);
+        if (!packed) return; // written unpacked
+        buf->packed = packed;
+        buf->packed_capacity = bound;
+    }
+    buf->packed_size = trace_pack_block(buf->data, buf->packed);
+}
+
+/**
+ * Writes consecutive rounds of the same sink with one vectored write each
+ */
+static void write_rounds(async_writer_t* aw, write_buf_t** batch, size_t count) {
+    struct iovec iov[ASYNC_WRITER_BUFFERS];
+    size_t i = 0;
+    while (i < count) {
+        trace_sink_t* sink = batch[i]->sink;
+        size_t run = 0;
+        while (i + run < count && batch[i + run]->sink == sink) {
+            write_buf_t* buf = batch[i + run];
+            buf->packed_size = 0;
+            if (sink->packed) pack_round(buf);
+            iov[run].iov_base = buf->packed_size ? buf->packed : buf->data;
+            iov[run].iov_len = buf->packed_size ? buf->packed_size : buf->size;
+            run++;
+        }
+
+        // After a lost dataset row nothing more may enter the manifest, resume would misalign the rows
+        if (!aw->dataset_failed && write_batch(aw, sink->trace.fd, iov, (int)run, sink->trace.offset)) {
+            for (size_t r = 0; r < run; ++r) {
+                const write_buf_t* buf = batch[i + r];
+                trace_commit_block(&sink->trace, buf->packed_size ? buf->packed : buf->data);
+                if (sink->latency) timings_to_evictions(sink->latency, buf->data);
+                if (sink->csv) write_block_csv(sink->csv, buf->data);
+            }
+            if (sink->csv) fflush(sink->csv);
+            if (sink->features) {
+                for (size_t r = 0; r < run; ++r) {
+                    const trace_block_t* block = batch[i + r]->data;
+                    if (batch[i + r]->has_features) {
+                        feature_write_record(sink->features, block->round, block->seed, &batch[i + r]->features);
+                    }
+                }
+                fflush(sink->features);
+            }
+            size_t appended = run;
+            for (size_t r = 0; sink->dataset && r < run; ++r) {
+                const trace_block_t* block = batch[i + r]->data;
+                if (!npy_dataset_append(sink->dataset, sink->label, trace_column(block, TRACE_COL_TIMINGS),
+                                        block->num_samples)) {
+                    fprintf(stderr, "Failed to append round %" PRIu64 " of %s to the dataset, stopping\n",
+                            block->round, sink->site);
+                    npy_dataset_truncate(sink->dataset, sink->dataset->num_rounds); // drop the partial row
+                    appended = r;
+                    pthread_mutex_lock(&aw->lock);
+                    aw->dataset_failed = 1;
+                    pthread_mutex_unlock(&aw->lock);
+                    break;
+                }
+            }
+            if (aw->manifest) {
+                // Only now are the rounds recoverable, mark them done
+                for (size_t r = 0; r < appended; ++r) {
+                    const trace_block_t* block = batch[i + r]->data;
+                    fprintf(aw->manifest, "%s %" PRIu64 " %" PRIu64 "\n", sink->site, block->round, block->seed);
+                }
+                fflush(aw->manifest);
+            }
+            aw->failures += run - appended;
+        } else {
+            aw->failures += run;
+        }
+        i += run;
+    }
+}
+
+static void* writer_main(void* arg) {
+    async_writer_t* aw = arg;
+    if (aw->core >= 0) pin_to_core(aw->core);
+    write_buf_t* batch[ASYNC_WRITER_BUFFERS];
+
+    pthread_mutex_lock(&aw->lock);
+    for (;;) {
+        while (aw->queue_len == 0 && !aw->stop) {
+            pthread_cond_wait(&aw->cond, &aw->lock);
+        }
+        if (aw->queue_len == 0 && aw->stop) break;
+
+        // Take everything that is queued and write it as one batch
+        size_t count = aw->queue_len;
+        for (size_t i = 0; i < count; ++i) {
+            batch[i] = aw->queue[(aw->queue_head + i) % ASYNC_WRITER_BUFFERS];
+        }
+        aw->queue_head = (aw->queue_head + count) % ASYNC_WRITER_BUFFERS;
+        aw->queue_len = 0;
+        aw->busy = 1;
+        pthread_mutex_unlock(&aw->lock);
+
+        write_rounds(aw, batch, count);
+
+        pthread_mutex_lock(&aw->lock);
+        for (size_t i = 0; i < count; ++i) {
+            aw->free_list[aw->num_free++] = batch[i];
+        }
+        aw->busy = 0;
+        pthread_cond_broadcast(&aw->cond);
+    }
+    pthread_mutex_unlock(&aw->lock);
+    return NULL;
+}
+
+int async_writer_start(async_writer_t* aw, int core, FILE* manifest) {
+    if (!aw) return 0;
+    memset(aw, 0, sizeof(async_writer_t));
+    aw->core = core;
+    aw->manifest = manifest;
+    for (size_t i = 0; i < ASYNC_WRITER_BUFFERS; ++i) {
+        aw->free_list[aw->num_free++] = &aw->bufs[i];
+    }
+#ifdef MG_HAVE_LIBURING
+    aw->uring = malloc(sizeof(struct io_uring));
+    aw->use_uring = aw->uring && io_uring_queue_init(URING_DEPTH, aw->uring, 0) == 0;
+#endif
+    pthread_mutex_init(&aw->lock, NULL);
+    pthread_cond_init(&aw->cond, NULL);
+    if (pthread_create(&aw->thread, NULL, writer_main, aw) != 0) {
+        perror("Failed to start writer thread");
+        pthread_mutex_destroy(&aw->lock);
+        pthread_cond_destroy(&aw->cond);
+#ifdef MG_HAVE_LIBURING
+        if (aw->use_uring) io_uring_queue_exit(aw->uring);
+        free(aw->uring);
+        aw->uring = NULL;
+        aw->use_uring = 0;
+#endif
+        return 0;
+    }
+    return 1;
+}
+
+int async_writer_submit(async_writer_t* aw, trace_sink_t* sink, const memorygrammer_t* mg, uint64_t round) {
+    if (!aw || !sink || !mg) return 0;
+
+    pthread_mutex_lock(&aw->lock);
+    if (aw->dataset_failed) {
+        pthread_mutex_unlock(&aw->lock);
+        return 0;
+    }
+    if (aw->num_free == 0) {
+        aw->stalls++;
+        while (aw->num_free == 0) {
+            pthread_cond_wait(&aw->cond, &aw->lock);
+        }
+    }
+    write_buf_t* buf = aw->free_list[--aw->num_free];
+    pthread_mutex_unlock(&aw->lock);
+
+    // Buffers only grow, so after the first rounds this is a plain memcpy
+    size_t size = trace_block_size(mg, NULL);
+    if (size > buf->capacity) {
+        void* data = realloc(buf->data, size);
+        if (!data) {
+            perror("Failed to grow write buffer");
+            pthread_mutex_lock(&aw->lock);
+            aw->free_list[aw->num_free++] = buf;
+            pthread_mutex_unlock(&aw->lock);
+            return 0;
+        }
+        buf->data = data;
+        buf->capacity = size;
+    }
+    trace_serialize_round(mg, round, buf->data);
+    buf->size = size;
+    buf->sink = sink;
+    buf->has_features = mg->features != NULL;
+    if (mg->features) feature_finish(mg->features, &buf->features);
+
+    pthread_mutex_lock(&aw->lock);
+    aw->queue[(aw->queue_head + aw->queue_len) % ASYNC_WRITER_BUFFERS] = buf;
+    aw->queue_len++;
+    pthread_cond_broadcast(&aw->cond);
+    pthread_mutex_unlock(&aw->lock);
+    return 1;
+}
+
+void async_writer_flush(async_writer_t* aw) {
+    if (!aw) return;
+    pthread_mutex_lock(&aw->lock);
+    while (aw->queue_len > 0 || aw->busy) {
+        pthread_cond_wait(&aw->cond, &aw->lock);
+    }
+    pthread_mutex_unlock(&aw->lock);
+}
+
+void async_writer_stop(async_writer_t* aw) {
+    if (!aw) return;
+    pthread_mutex_lock(&aw->lock);
+    aw->stop = 1;
+    pthread_cond_broadcast(&aw->cond);
+    pthread_mutex_unlock(&aw->lock);
+    pthread_join(aw->thread, NULL); // drains the queue before exiting
+
+    pthread_mutex_destroy(&aw->lock);
+    pthread_cond_destroy(&aw->cond);
+#ifdef MG_HAVE_LIBURING
+    if (aw->use_uring) io_uring_queue_exit(aw->uring);
+    free(aw->uring);
+    aw->uring = NULL;
+#endif
+    for (size_t i = 0; i < ASYNC_WRITER_BUFFERS; ++i) {
+        free(aw->bufs[i].data);
+        free(aw->bufs[i].packed);
+        aw->bufs[i].data = NULL;
+        aw->bufs[i].packed = NULL;
+    }
+}
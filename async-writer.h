@@ -0,0 +1,108 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include "trace-file.h"
+#include "npy-dataset.h"
+
+#define ASYNC_WRITER_BUFFERS 8 // round buffers in the pool (= queue depth)
+
+// Optional outputs of a sink, next to the binary trace
+#define SINK_CSV      (1U << 0) // <site>.csv, legacy "value, count" rows
+#define SINK_FEATURES (1U << 1) // <site>.features.csv, one feature record per round
+#define SINK_PACKED   (1U << 2) // Trace rounds are written delta + varint packed (TRACE_PACKED)
+#define SINK_EVICTIONS (1U << 3) // CSV and dataset values are estimated evictions instead of cycles (needs calibration)
+
+/**
+ * Output files of one site, kept open for the whole run
+ */
+typedef struct {
+    char site[128];             // Site label, also used in the manifest
+    trace_writer_t trace;       // Binary trace
+    FILE* csv;                  // Legacy "value, count" CSV, NULL to skip it
+    FILE* features;             // Per-round feature records, NULL to skip them
+    int packed;                 // Pack trace rounds on the writer thread
+    const cache_latency_t* latency;     // Set with SINK_EVICTIONS: converts sweep cycles to evictions
+    npy_dataset_t* dataset;     // Shared .npy dataset the timings are appended to, NULL to skip it
+    int32_t label;              // Label of the site's rounds in the dataset
+} trace_sink_t;
+
+/**
+ * A serialized round waiting to be written
+ */
+typedef struct {
+    void* data;                 // trace_block_t followed by its columns
+    size_t size;
+    size_t capacity;
+    void* packed;               // Packed copy of data, written instead of it when smaller
+    size_t packed_size;         // 0 when data is written as is
+    size_t packed_capacity;
+    trace_sink_t* sink;
+    int has_features;
+    feature_record_t features;  // Finished on the probing thread, formatted on the writer
+} write_buf_t;
+
+/**
+ * Writer thread fed by a bounded queue of finished rounds.
+ * Buffers come from a fixed pool and are recycled once written,
+ * so after warm-up the probing thread only pays a memcpy per round.
+ */
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    write_buf_t bufs[ASYNC_WRITER_BUFFERS];
+    write_buf_t* free_list[ASYNC_WRITER_BUFFERS];
+    size_t num_free;
+    write_buf_t* queue[ASYNC_WRITER_BUFFERS];   // FIFO of rounds to write
+    size_t queue_head;
+    size_t queue_len;
+    int busy;                   // The thread is writing a batch
+    int stop;
+    int core;                   // Core the writer is pinned to, -1 for no pinning
+    size_t stalls;              // Submits that had to wait for a free buffer
+    size_t failures;            // Rounds that could not be written
+    int dataset_failed;         // A dataset append failed: later rounds are dropped, submits fail
+    int use_uring;              // 1 when writes go through io_uring
+    void* uring;                // struct io_uring, only with MG_HAVE_LIBURING
+    FILE* manifest;             // "site round seed" is appended once a round is on disk, NULL for none
+} async_writer_t;
+
+/**
+ * Open (or append to) <site>.mgtrace and the SINK_* outputs selected in `outputs`.
+ * Existing files are cut back to their first `rounds` rounds, the ones the manifest
+ * records as done, so a round written just before a crash isn't stored twice
+ */
+int open_sink(trace_sink_t* sink, const char* site, const cpu_config_t* config,
+              uint64_t interval_cycles, uint64_t probe_cycles, unsigned outputs, size_t rounds);
+
+/**
+ * Write the trace index/footer and close the sink's files
+ */
+int close_sink(trace_sink_t* sink);
+
+/**
+ * Start the writer thread on `core` (-1 for no pinning).
+ * If manifest is not NULL every round is recorded there once it is safely written.
+ */
+int async_writer_start(async_writer_t* aw, int core, FILE* manifest);
+
+/**
+ * Copy the last probe of mg into a pooled buffer and queue it for `sink`.
+ * Only waits if every buffer is still queued (disk slower than the probe).
+ * Fails once a dataset append failed, so the campaign stops with a consistent manifest.
+ */
+int async_writer_submit(async_writer_t* aw, trace_sink_t* sink, const memorygrammer_t* mg, uint64_t round);
+
+/**
+ * Wait until every queued round is on disk
+ */
+void async_writer_flush(async_writer_t* aw);
+
+/**
+ * Flush, stop the thread and release the pool
+ */
+void async_writer_stop(async_writer_t* aw);
+
+#endif //ASYNC_WRITER_H
@@ -0,0 +1,534 @@
+#define _GNU_SOURCE
+#include "campaign.h"
+#include "memorygrammer.h"
+#include "async-writer.h"
+#include "shuffler.h"
+#include "classifier.h"
+#include "latency-calibration.h"
+#include "utils.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NS_PER_MS 1000000ULL
+
+static volatile sig_atomic_t campaignStop;
+
+static void stop_campaign(int sig) {
+    (void)sig;
+    campaignStop = 1;
+}
+
+static char* trim(char* s) {
+    while (isspace((unsigned char)*s)) s++;
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+static int parse_int(const char* value, long min, long max, long* out) {
+    char* end;
+    long v = strtol(value, &end, 10);
+    if (end == value || *trim(end) != '\0' || v < min || v > max) return 0;
+    *out = v;
+    return 1;
+}
+
+static int add_target(campaign_t* campaign, char* value) {
+    if (campaign->num_targets == CAMPAIGN_MAX_TARGETS) {
+        fprintf(stderr, "Too many targets (max %d)\n", CAMPAIGN_MAX_TARGETS);
+        return 0;
+    }
+    campaign_target_t* target = &campaign->targets[campaign->num_targets];
+    memset(target, 0, sizeof(campaign_target_t));
+
+    char* rounds = value + strcspn(value, " \t");
+    if (*rounds) {
+        *rounds++ = '\0';
+        long r;
+        if (!parse_int(rounds, 1, INT32_MAX, &r)) return 0;
+        target->rounds = (unsigned)r;
+    }
+    if (strlen(value) >= sizeof(target->url)) return 0;
+    strcpy(target->url, value);
+    parse_site_name(target->url, target->site, sizeof(target->site));
+    if (target->site[0] == '\0') return 0;
+
+    // Two targets writing to the same files would corrupt each other
+    for (size_t t = 0; t < campaign->num_targets; ++t) {
+        if (strcmp(campaign->targets[t].site, target->site) == 0) {
+            fprintf(stderr, "Site %s is listed twice\n", target->site);
+            return 0;
+        }
+    }
+    campaign->num_targets++;
+    return 1;
+}
+
+static int set_key(campaign_t* campaign, const char* key, char* value) {
+    long v;
+    if (strcmp(key, "target") == 0) return add_target(campaign, value);
+    if (strcmp(key, "rounds") == 0) {
+        if (!parse_int(value, 1, INT32_MAX, &v)) return 0;
+        campaign->rounds = (unsigned)v;
+    } else if (strcmp(key, "order") == 0) {
+        if (strcmp(value, "blocked") == 0) campaign->order = ORDER_BLOCKED;
+        else if (strcmp(value, "round-robin") == 0) campaign->order = ORDER_ROUND_ROBIN;
+        else return 0;
+    } else if (strcmp(key, "probe") == 0) {
+        if (strcmp(value, "free") == 0) campaign->probe = PROBE_FREE;
+        else if (strcmp(value, "catch-up") == 0) campaign->probe = PROBE_CATCH_UP;
+        else if (strcmp(value, "drop") == 0) campaign->probe = PROBE_DROP;
+        else return 0;
+    } else if (strcmp(key, "probe_ms") == 0) {
+        if (!parse_int(value, 1, INT32_MAX, &v)) return 0;
+        campaign->probe_ms = (uint64_t)v;
+    } else if (strcmp(key, "interval_ms") == 0) {
+        if (!parse_int(value, 0, INT32_MAX, &v)) return 0;
+        campaign->interval_ms = (uint64_t)v;
+    } else if (strcmp(key, "probe_core") == 0) {
+        if (!parse_int(value, 0, CPU_SETSIZE - 1, &v)) return 0;
+        campaign->probe_core = (int)v;
+    } else if (strcmp(key, "victim_core") == 0) {
+        if (!parse_int(value, 0, CPU_SETSIZE - 1, &v)) return 0;
+        campaign->victim_core = (int)v;
+    } else if (strcmp(key, "helper_core") == 0) {
+        if (!parse_int(value, -1, CPU_SETSIZE - 1, &v)) return 0;
+        campaign->helper_core = (int)v;
+    } else if (strcmp(key, "csv") == 0) {
+        if (!parse_int(value, 0, 1, &v)) return 0;
+        campaign->csv = (int)v;
+    } else if (strcmp(key, "features") == 0) {
+        if (!parse_int(value, 0, 1, &v)) return 0;
+        campaign->features = (int)v;
+    } else if (strcmp(key, "calibrate") == 0) {
+        if (!parse_int(value, 0, 1, &v)) return 0;
+        campaign->calibrate = (int)v;
+    } else if (strcmp(key, "units") == 0) {
+        if (strcmp(value, "cycles") == 0) campaign->evictions = 0;
+        else if (strcmp(value, "evictions") == 0) campaign->evictions = 1;
+        else return 0;
+    } else if (strcmp(key, "compress") == 0) {
+        if (!parse_int(value, 0, 1, &v)) return 0;
+        campaign->compress = (int)v;
+    } else if (strcmp(key, "victim") == 0) {
+        if (*value == '\0' || strlen(value) >= sizeof(campaign->victim)) return 0;
+        strcpy(campaign->victim, value);
+    } else if (strcmp(key, "victim_gate") == 0) {
+        if (strcmp(value, "exec") == 0) campaign->victim_gate = VICTIM_GATE_EXEC;
+        else if (strcmp(value, "stdin") == 0) campaign->victim_gate = VICTIM_GATE_STDIN;
+        else return 0;
+    } else if (strcmp(key, "victim_pool") == 0) {
+        if (!parse_int(value, 1, VICTIM_POOL_MAX, &v)) return 0;
+        campaign->victim_pool = (unsigned)v;
+    } else if (strcmp(key, "model") == 0) {
+        if (strlen(value) >= sizeof(campaign->model)) return 0;
+        strcpy(campaign->model, value);
+    } else if (strcmp(key, "dataset") == 0) {
+        if (strlen(value) >= sizeof(campaign->dataset)) return 0;
+        strcpy(campaign->dataset, value);
+    } else if (strcmp(key, "manifest") == 0) {
+        if (strlen(value) >= sizeof(campaign->manifest)) return 0;
+        strcpy(campaign->manifest, value);
+    } else {
+        fprintf(stderr, "Unknown key '%s'\n", key);
+        return 0;
+    }
+    return 1;
+}
+
+int load_campaign(campaign_t* campaign, const char* path) {
+    if (!campaign || !path) return 0;
+    memset(campaign, 0, sizeof(campaign_t));
+    campaign->rounds = 1;
+    campaign->order = ORDER_BLOCKED;
+    campaign->probe = PROBE_FREE;
+    campaign->probe_ms = 5000;
+    campaign->interval_ms = 2;
+    campaign->probe_core = 0;
+    campaign->victim_core = 2;
+    campaign->helper_core = 1;
+    campaign->csv = 1;
+    campaign->features = 1;
+    campaign->compress = 1;
+    campaign->calibrate = 1;
+    strcpy(campaign->manifest, "campaign.manifest");
+    strcpy(campaign->victim, "google-chrome --new-window " VICTIM_URL_ARG);
+    campaign->victim_gate = VICTIM_GATE_EXEC;
+    campaign->victim_pool = 2;
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror("Failed to open campaign file");
+        return 0;
+    }
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        line[strcspn(line, "#\n")] = '\0';
+        char* key = trim(line);
+        if (*key == '\0') continue;
+        char* eq = strchr(key, '=');
+        if (!eq) {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, line_no);
+            fclose(file);
+            return 0;
+        }
+        *eq = '\0';
+        if (!set_key(campaign, trim(key), trim(eq + 1))) {
+            fprintf(stderr, "%s:%d: invalid value for '%s'\n", path, line_no, trim(key));
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+
+    if (campaign->num_targets == 0) {
+        fprintf(stderr, "%s: no targets\n", path);
+        return 0;
+    }
+    for (size_t t = 0; t < campaign->num_targets; ++t) {
+        if (campaign->targets[t].rounds == 0) campaign->targets[t].rounds = campaign->rounds;
+    }
+    return 1;
+}
+
+/**
+ * <prefix>.labels.txt maps dataset labels to sites: line i is the site of label i.
+ * A fresh campaign writes it in target order. On resume the stored map is kept and
+ * targets it doesn't know yet are appended, so stored labels never change meaning.
+ * Fails if a target with stored rounds is missing from the map or the map lists a site twice
+ */
+static int load_dataset_labels(const campaign_t* campaign, const char* prefix, int resumed, const size_t* stored,
+                               int32_t* labels) {
+    char path[CAMPAIGN_PATH_LEN + 16];
+    snprintf(path, sizeof(path), "%s.labels.txt", prefix);
+    char (*sites)[128] = NULL;
+    size_t num_sites = 0, capacity = 0;
+    FILE* file = resumed ? fopen(path, "r") : NULL;
+    int ok = 1;
+    if (file) {
+        char line[256];
+        while (ok && fgets(line, sizeof(line), file)) {
+            char site[128];
+            if (sscanf(line, "%127s", site) != 1) continue;
+            for (size_t i = 0; i < num_sites; ++i) {
+                if (strcmp(sites[i], site) == 0) {
+                    fprintf(stderr, "%s lists %s twice\n", path, site);
+                    ok = 0;
+                }
+            }
+            if (ok && num_sites == capacity) {
+                capacity = capacity ? capacity * 2 : CAMPAIGN_MAX_TARGETS;
+                char (*grown)[128] = realloc(sites, capacity * sizeof(*sites));
+                if (!grown) {
+                    perror("Failed to read dataset labels");
+                    ok = 0;
+                    break;
+                }
+                sites = grown;
+            }
+            if (ok) strcpy(sites[num_sites++], site);
+        }
+        fclose(file);
+    }
+
+    // New targets get the next free labels
+    file = ok ? fopen(path, file ? "a" : "w") : NULL;
+    if (ok && !file) {
+        perror("Failed to open dataset labels");
+        ok = 0;
+    }
+    size_t next = num_sites;
+    for (size_t t = 0; ok && t < campaign->num_targets; ++t) {
+        const char* site = campaign->targets[t].site;
+        size_t label = next;
+        for (size_t i = 0; i < num_sites; ++i) {
+            if (strcmp(sites[i], site) == 0) label = i;
+        }
+        if (label == next) {
+            if (stored[t]) {
+                fprintf(stderr, "%s has stored rounds but no label in %s, refusing to resume\n", site, path);
+                ok = 0;
+                break;
+            }
+            fprintf(file, "%s\n", site);
+            next++;
+        }
+        labels[t] = (int32_t)label;
+    }
+    if (file && fclose(file) != 0) ok = 0;
+    free(sites);
+    return ok;
+}
+
+/**
+ * Marks the rounds listed in the manifest as done. stored[t] counts every round of
+ * target t in the manifest, i.e. the rounds its output files are expected to hold,
+ * stored_total the rounds of every site (the dataset is shared).
+ * Returns 1 if the manifest existed, 0 for a fresh campaign
+ */
+static int read_manifest(const campaign_t* campaign, uint8_t** done, size_t* num_done, size_t* stored,
+                         size_t* stored_total) {
+    FILE* file = fopen(campaign->manifest, "r");
+    if (!file) return 0;
+    char line[256];
+    char site[128];
+    uint64_t round, seed;
+    while (fgets(line, sizeof(line), file)) {
+        // A torn last line from a crash simply does not count
+        if (sscanf(line, "%127s %" SCNu64 " %" SCNu64, site, &round, &seed) != 3) continue;
+        (*stored_total)++;
+        for (size_t t = 0; t < campaign->num_targets; ++t) {
+            const campaign_target_t* target = &campaign->targets[t];
+            if (strcmp(target->site, site) == 0) stored[t]++;
+            if (strcmp(target->site, site) == 0 && round < target->rounds && !done[t][round]) {
+                done[t][round] = 1;
+                (*num_done)++;
+            }
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+/**
+ * Releases a parked victim on target, probes while its page loads and queues the round for writing.
+ * Rounds the model gave a verdict for are counted in classified, the ones naming the target in correct
+ */
+static int run_round(memorygrammer_t* mg, const campaign_t* campaign, const campaign_target_t* target,
+                     unsigned round, uint64_t interval_cycles, uint64_t probe_cycles,
+                     victim_pool_t* victims, const classifier_t* model, size_t* classified, size_t* correct,
+                     async_writer_t* writer, trace_sink_t* sink) {
+    printf("Probing site: %s (round %u)\n", target->site, round);
+    victim_t victim;
+    uint64_t release_tsc;
+    background_wait(mg); // the next lane is linked before the victim starts, not during its probe
+    if (!victim_pool_release(victims, target->url, &victim, &release_tsc)) return 0;
+
+    // Scheduled timelines start at the release, so slot 0 is the first sample of the victim's life
+    switch (campaign->probe) {
+        case PROBE_CATCH_UP:
+            run_probe_scheduled(mg, interval_cycles, probe_cycles, SCHED_CATCH_UP, release_tsc);
+            break;
+        case PROBE_DROP:
+            run_probe_scheduled(mg, interval_cycles, probe_cycles, SCHED_DROP, release_tsc);
+            break;
+        default:
+            run_probe(mg, interval_cycles, probe_cycles);
+    }
+
+    // Verdict as soon as the window closes, before anything else touches the caches
+    verdict_t verdict;
+    if (model && classify_round(model, mg, &verdict)) {
+        const char* name = classifier_class_name(model, verdict.label);
+        printf("Verdict: %s (p = %.2f, %" PRIu64 " ns)\n", name, verdict.probs[verdict.label],
+               tsc_cycles_to_ns(&mg->config->timer, verdict.cycles));
+        (*classified)++;
+        if (strcmp(name, target->site) == 0) (*correct)++;
+    }
+
+    victim_pool_retire(victims, &victim);
+    if (mg->counter_failures) {
+        fprintf(stderr, "Counter reads failed on %zu samples, their counters are zero.\n", mg->counter_failures);
+    }
+
+    // The writer records the round in the manifest once it is on disk
+    if (!async_writer_submit(writer, sink, mg, round)) {
+        fprintf(stderr, "Failed to queue round output.\n");
+        return 0;
+    }
+    return 1;
+}
+
+int run_campaign(const campaign_t* campaign, cpu_config_t* config) {
+    if (!campaign || !config) return 0;
+    size_t num_targets = campaign->num_targets;
+    uint8_t* done[CAMPAIGN_MAX_TARGETS] = {0};
+    size_t stored[CAMPAIGN_MAX_TARGETS] = {0};
+    size_t stored_total = 0;
+    int32_t labels[CAMPAIGN_MAX_TARGETS] = {0};
+    size_t total_rounds = 0, num_done = 0;
+    unsigned max_rounds = 0;
+    for (size_t t = 0; t < num_targets; ++t) {
+        done[t] = calloc(campaign->targets[t].rounds, 1);
+        if (!done[t]) {
+            perror("Failed to allocate campaign state");
+            for (size_t i = 0; i < t; ++i) free(done[i]);
+            return 0;
+        }
+        total_rounds += campaign->targets[t].rounds;
+        if (campaign->targets[t].rounds > max_rounds) max_rounds = campaign->targets[t].rounds;
+    }
+
+    int resumed = read_manifest(campaign, done, &num_done, stored, &stored_total);
+    if (resumed) {
+        printf("Resuming campaign: %zu of %zu rounds already done\n", num_done, total_rounds);
+    } else {
+        // Fresh campaign: start every output from scratch
+        for (size_t t = 0; t < num_targets; ++t) {
+            empty_csv(campaign->targets[t].site);
+            empty_trace(campaign->targets[t].site);
+            empty_features(campaign->targets[t].site);
+        }
+    }
+
+    int ok = 1;
+    memorygrammer_t mg;
+    trace_sink_t* sinks = calloc(num_targets, sizeof(trace_sink_t));
+    size_t num_sinks = 0;
+    FILE* manifest = NULL;
+    npy_dataset_t dataset;
+    int dataset_open = 0;
+    async_writer_t writer;
+    int writer_started = 0;
+    victim_pool_t victims;
+    int victims_started = 0;
+    classifier_t model;
+    int model_loaded = 0;
+    size_t classified = 0, correct = 0;
+    int mg_ready = 0;
+    int helper_core = campaign->helper_core < config->num_logical_processors ? campaign->helper_core : -1;
+    uint64_t interval_cycles = tsc_ns_to_cycles(&config->timer, campaign->interval_ms * NS_PER_MS);
+    uint64_t probe_cycles = tsc_ns_to_cycles(&config->timer, campaign->probe_ms * NS_PER_MS);
+
+    if (num_done == total_rounds) {
+        printf("Campaign already complete (%zu rounds).\n", total_rounds);
+        goto cleanup;
+    }
+    if (!sinks) {
+        perror("Failed to allocate sinks");
+        ok = 0;
+        goto cleanup;
+    }
+
+    if (campaign->model[0]) {
+        if (!classifier_load(&model, campaign->model)) {
+            ok = 0;
+            goto cleanup;
+        }
+        model_loaded = 1;
+    }
+
+    pin_to_core(campaign->probe_core);
+    // One memorygrammer for the whole campaign: the arena, chains and counters are set up once
+    if (!init_memorygrammer(&mg, config)) {
+        fprintf(stderr, "Failed to initialize memorygrammer.\n");
+        ok = 0;
+        goto cleanup;
+    }
+    mg_ready = 1;
+    enable_perf_counters(&mg); // falls back to timing only when not permitted
+    // Before the shuffler starts: calibration relinks the chain
+    if (campaign->calibrate && calibrate_latencies(&mg, NULL)) {
+        print_cpu_config(config);
+    }
+    if (campaign->evictions && !config->latency.calibrated) {
+        fprintf(stderr, "units = evictions needs a calibrated run, writing cycles.\n");
+    }
+    // Feature rows (and the model's verdicts) in the same unit as the CSV and the dataset
+    if (campaign->evictions && config->latency.calibrated) mg.feature_latency = &config->latency;
+    if (campaign->features && !enable_features(&mg, probe_cycles)) {
+        ok = 0;
+        goto cleanup;
+    }
+    if (helper_core >= 0 && !start_background_shuffler(&mg, helper_core)) {
+        fprintf(stderr, "Background shuffler unavailable, reshuffling between rounds.\n");
+    }
+
+    unsigned outputs = (campaign->csv ? SINK_CSV : 0) | (campaign->features ? SINK_FEATURES : 0) |
+                       (campaign->compress ? SINK_PACKED : 0) | (campaign->evictions ? SINK_EVICTIONS : 0);
+    for (; num_sinks < num_targets; ++num_sinks) {
+        if (!open_sink(&sinks[num_sinks], campaign->targets[num_sinks].site, config,
+                       interval_cycles, probe_cycles, outputs, stored[num_sinks])) {
+            fprintf(stderr, "Failed to open output files.\n");
+            ok = 0;
+            goto cleanup;
+        }
+    }
+    if (campaign->dataset[0]) {
+        if (!load_dataset_labels(campaign, campaign->dataset, resumed, stored, labels) ||
+            !npy_dataset_open(&dataset, campaign->dataset, !resumed)) {
+            ok = 0;
+            goto cleanup;
+        }
+        dataset_open = 1;
+        // Rounds appended after the last manifest line are run again
+        if (!npy_dataset_truncate(&dataset, stored_total)) {
+            ok = 0;
+            goto cleanup;
+        }
+        for (size_t t = 0; t < num_sinks; ++t) {
+            sinks[t].dataset = &dataset;
+            sinks[t].label = labels[t];
+        }
+    }
+    manifest = fopen(campaign->manifest, "a");
+    if (!manifest) {
+        perror("Failed to open manifest");
+        ok = 0;
+        goto cleanup;
+    }
+    if (!async_writer_start(&writer, helper_core, manifest)) {
+        ok = 0;
+        goto cleanup;
+    }
+    writer_started = 1;
+    // Victims are launched and parked ahead of their round on the helper core
+    if (!victim_pool_init(&victims, campaign->victim, campaign->victim_gate, campaign->victim_pool,
+                          campaign->victim_core, helper_core)) {
+        fprintf(stderr, "Failed to start the victim pool.\n");
+        ok = 0;
+        goto cleanup;
+    }
+    victims_started = 1;
+
+    campaignStop = 0;
+    signal(SIGINT, stop_campaign);
+    signal(SIGTERM, stop_campaign);
+    // Blocked walks target-major, round-robin walks round-major
+    size_t outer = campaign->order == ORDER_BLOCKED ? num_targets : max_rounds;
+    size_t inner = campaign->order == ORDER_BLOCKED ? max_rounds : num_targets;
+    for (size_t i = 0; i < outer && ok && !campaignStop; ++i) {
+        for (size_t j = 0; j < inner && ok && !campaignStop; ++j) {
+            size_t t = campaign->order == ORDER_BLOCKED ? i : j;
+            unsigned round = (unsigned)(campaign->order == ORDER_BLOCKED ? j : i);
+            if (round >= campaign->targets[t].rounds || done[t][round]) continue;
+            ok = run_round(&mg, campaign, &campaign->targets[t], round, interval_cycles, probe_cycles,
+                           &victims, model_loaded ? &model : NULL, &classified, &correct, &writer, &sinks[t]);
+            if (ok) num_done++;
+        }
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    if (classified) {
+        printf("Verdicts matching the target: %zu of %zu\n", correct, classified);
+    }
+    if (campaignStop) {
+        printf("Stopped, %zu of %zu rounds done. Run again to resume.\n", num_done, total_rounds);
+    }
+
+cleanup:
+    if (victims_started) victim_pool_free(&victims);
+    if (model_loaded) classifier_free(&model);
+    if (writer_started) {
+        async_writer_stop(&writer);
+        if (writer.failures) {
+            fprintf(stderr, "%zu rounds could not be written.\n", writer.failures);
+            ok = 0;
+        }
+    }
+    if (manifest) fclose(manifest);
+    if (dataset_open) npy_dataset_close(&dataset);
+    for (size_t t = 0; t < num_sinks; ++t) close_sink(&sinks[t]);
+    free(sinks);
+    if (mg_ready) free_memorygrammer(&mg);
+    for (size_t t = 0; t < num_targets; ++t) free(done[t]);
+    return ok;
+}
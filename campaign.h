@@ -0,0 +1,84 @@
+#ifndef CAMPAIGN_H
+#define CAMPAIGN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu-config.h"
+#include "victim-pool.h"
+
+#define CAMPAIGN_MAX_TARGETS 64
+#define CAMPAIGN_PATH_LEN 256
+
+/**
+ * Order in which the rounds of the targets are run
+ */
+typedef enum {
+    ORDER_BLOCKED,              // Every round of a target before moving to the next one
+    ORDER_ROUND_ROBIN           // Round r of every target, then round r + 1, ...
+} campaign_order_t;
+
+/**
+ * How a round samples
+ */
+typedef enum {
+    PROBE_FREE,                 // run_probe(): back to back with interval spacing
+    PROBE_CATCH_UP,             // run_probe_scheduled() with SCHED_CATCH_UP
+    PROBE_DROP                  // run_probe_scheduled() with SCHED_DROP
+} campaign_probe_t;
+
+typedef struct {
+    char url[CAMPAIGN_PATH_LEN];
+    char site[128];             // Output prefix and manifest key
+    unsigned rounds;
+} campaign_target_t;
+
+/**
+ * A data collection campaign, read from a key = value file:
+ *   target = <url> [rounds]    (repeatable, rounds defaults to `rounds`)
+ *   rounds, order = blocked | round-robin, probe = free | catch-up | drop,
+ *   probe_ms, interval_ms, probe_core, victim_core, helper_core (-1 = none),
+ *   csv = 0 | 1, features = 0 | 1, compress = 0 | 1 (delta + varint packed traces), manifest = <path>,
+ *   calibrate = 0 | 1 (measure load latencies first),
+ *   units = cycles | evictions (CSV, feature and dataset values; traces keep cycles),
+ *   dataset = <prefix of the .npy dataset, a round's label is its site's line in <prefix>.labels.txt>,
+ *   victim = <command, {url} is replaced>, victim_gate = exec | stdin, victim_pool = <parked victims>,
+ *   model = <exported classifier, prints a verdict after every round>
+ * '#' starts a comment.
+ */
+typedef struct {
+    campaign_target_t targets[CAMPAIGN_MAX_TARGETS];
+    size_t num_targets;
+    unsigned rounds;
+    campaign_order_t order;
+    campaign_probe_t probe;
+    uint64_t probe_ms;
+    uint64_t interval_ms;
+    int probe_core;
+    int victim_core;
+    int helper_core;            // Background shuffler, writer thread and victim refill
+    int csv;
+    int features;               // Per-round feature records in <site>.features.csv
+    int compress;               // Pack the trace columns (SINK_PACKED)
+    int calibrate;              // Run calibrate_latencies() before the first round
+    int evictions;              // CSV, features and dataset report evictions (SINK_EVICTIONS)
+    char manifest[CAMPAIGN_PATH_LEN];
+    char dataset[CAMPAIGN_PATH_LEN];    // Empty for no .npy dataset
+    char victim[CAMPAIGN_PATH_LEN];     // Workload started for every round
+    victim_gate_t victim_gate;
+    unsigned victim_pool;
+    char model[CAMPAIGN_PATH_LEN];      // Empty for no classification
+} campaign_t;
+
+/**
+ * Parse a campaign file. Returns 1 on success, 0 on error (reported on stderr)
+ */
+int load_campaign(campaign_t* campaign, const char* path);
+
+/**
+ * Run every round that is not yet in the manifest with a single memorygrammer.
+ * Without a manifest the outputs are truncated first, otherwise rounds are appended.
+ * Ctrl-C stops after the current round; running again resumes from there.
+ */
+int run_campaign(const campaign_t* campaign, cpu_config_t* config);
+
+#endif //CAMPAIGN_H
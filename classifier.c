@@ -0,0 +1,235 @@
+#include "classifier.h"
+#include "utils.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t pad8(size_t bytes) {
+    return (bytes + 7) & ~(size_t)7;
+}
+
+/**
+ * Point *array at the next `bytes` of the model, 0 if the file is too short
+ */
+static int take(const uint8_t* data, size_t size, size_t* offset, size_t bytes, const void** array) {
+    if (*offset > size || bytes > size - *offset) return 0;
+    *array = data + *offset;
+    *offset += pad8(bytes);
+    return 1;
+}
+
+/**
+ * Reject anything that could send a traversal out of bounds or into a loop
+ */
+static int validate_forest(const classifier_t* model) {
+    const model_header_t* h = &model->header;
+    for (uint32_t t = 0; t < h->num_trees; ++t) {
+        if (model->tree_roots[t] >= h->num_nodes) return 0;
+    }
+    for (uint32_t i = 0; i < h->num_nodes; ++i) {
+        if (model->feature[i] < 0) {
+            if (model->left[i] >= h->num_leaves) return 0;
+        } else if ((uint32_t)model->feature[i] >= h->num_features ||
+                   model->left[i] <= i || model->left[i] >= h->num_nodes ||
+                   model->right[i] <= i || model->right[i] >= h->num_nodes) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int classifier_load(classifier_t* model, const char* path) {
+    if (!model || !path) return 0;
+    memset(model, 0, sizeof(classifier_t));
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror("Failed to open model");
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* data = length > 0 ? malloc((size_t)length) : NULL;
+    if (!data || fread(data, 1, (size_t)length, file) != (size_t)length) {
+        perror("Failed to read model");
+        free(data);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    size_t size = (size_t)length;
+
+    model_header_t* h = &model->header;
+    if (size < sizeof(model_header_t)) goto invalid;
+    memcpy(h, data, sizeof(model_header_t));
+    if (memcmp(h->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0 || h->version != MODEL_VERSION) goto invalid;
+    if (h->num_features != FEATURE_VECTOR_LEN) {
+        fprintf(stderr, "Model expects %u features, rounds have %d\n", h->num_features, FEATURE_VECTOR_LEN);
+        goto invalid;
+    }
+    if (h->num_classes < 2 || h->num_classes > MODEL_MAX_CLASSES) goto invalid;
+    if (h->num_trees == 0 && h->logit_rows == 0) goto invalid;
+    if (h->logit_rows != 0 && h->logit_rows != (h->num_classes == 2 ? 1 : h->num_classes)) goto invalid;
+
+    size_t offset = pad8(sizeof(model_header_t));
+    const size_t nodes = h->num_nodes, features = h->num_features;
+    if (!take(data, size, &offset, (size_t)h->num_classes * MODEL_CLASS_NAME_LEN, (const void**)&model->class_names) ||
+        !take(data, size, &offset, h->num_trees * sizeof(uint32_t), (const void**)&model->tree_roots) ||
+        !take(data, size, &offset, nodes * sizeof(int32_t), (const void**)&model->feature) ||
+        !take(data, size, &offset, nodes * sizeof(float), (const void**)&model->threshold) ||
+        !take(data, size, &offset, nodes * sizeof(uint32_t), (const void**)&model->left) ||
+        !take(data, size, &offset, nodes * sizeof(uint32_t), (const void**)&model->right) ||
+        !take(data, size, &offset, (size_t)h->num_leaves * h->num_classes * sizeof(float),
+              (const void**)&model->leaf_probs) ||
+        !take(data, size, &offset, features * sizeof(float), (const void**)&model->scale_mean) ||
+        !take(data, size, &offset, features * sizeof(float), (const void**)&model->scale_std) ||
+        !take(data, size, &offset, (size_t)h->logit_rows * features * sizeof(float), (const void**)&model->weights) ||
+        !take(data, size, &offset, h->logit_rows * sizeof(float), (const void**)&model->bias)) {
+        goto invalid;
+    }
+    for (uint32_t c = 0; c < h->num_classes; ++c) {
+        if (model->class_names[(size_t)c * MODEL_CLASS_NAME_LEN + MODEL_CLASS_NAME_LEN - 1] != '\0') goto invalid;
+    }
+    for (uint32_t f = 0; h->logit_rows && f < h->num_features; ++f) {
+        if (!(model->scale_std[f] > 0)) goto invalid;
+    }
+    model->data = data;
+    if (!validate_forest(model)) goto invalid;
+    return 1;
+
+invalid:
+    fprintf(stderr, "%s is not a valid model\n", path);
+    free(data);
+    memset(model, 0, sizeof(classifier_t));
+    return 0;
+}
+
+void classifier_free(classifier_t* model) {
+    if (!model) return;
+    free(model->data);
+    memset(model, 0, sizeof(classifier_t));
+}
+
+/**
+ * Adds the mean leaf distribution of the forest to probs.
+ * MODEL_TREE_BATCH trees descend one level per step, so their node loads overlap.
+ */
+static void forest_probs(const classifier_t* model, const float* x, float* probs) {
+    const model_header_t* h = &model->header;
+    const uint32_t num_classes = h->num_classes;
+    const int32_t* feature = model->feature;
+    const float* threshold = model->threshold;
+    const uint32_t* left = model->left;
+    const uint32_t* right = model->right;
+    const float scale = 1.0f / (float)h->num_trees;
+
+    for (uint32_t t0 = 0; t0 < h->num_trees; t0 += MODEL_TREE_BATCH) {
+        const uint32_t batch = h->num_trees - t0 < MODEL_TREE_BATCH ? h->num_trees - t0 : MODEL_TREE_BATCH;
+        uint32_t node[MODEL_TREE_BATCH];
+        for (uint32_t b = 0; b < batch; ++b) node[b] = model->tree_roots[t0 + b];
+
+        uint32_t active = batch;
+        while (active) {
+            active = 0;
+            for (uint32_t b = 0; b < batch; ++b) {
+                const uint32_t n = node[b];
+                const int32_t f = feature[n];
+                if (f < 0) continue;
+                node[b] = x[f] <= threshold[n] ? left[n] : right[n];
+                active++;
+            }
+        }
+        for (uint32_t b = 0; b < batch; ++b) {
+            const float* leaf = model->leaf_probs + (size_t)left[node[b]] * num_classes;
+            for (uint32_t c = 0; c < num_classes; ++c) probs[c] += leaf[c] * scale;
+        }
+    }
+}
+
+/**
+ * Adds the logistic regression probabilities to probs (sigmoid for two classes, else softmax)
+ */
+static void logistic_probs(const classifier_t* model, const float* x, float* probs) {
+    const model_header_t* h = &model->header;
+    float z[FEATURE_VECTOR_LEN];
+    for (uint32_t f = 0; f < h->num_features; ++f) {
+        z[f] = (x[f] - model->scale_mean[f]) / model->scale_std[f];
+    }
+    double logits[MODEL_MAX_CLASSES];
+    double max_logit = -INFINITY;
+    for (uint32_t r = 0; r < h->logit_rows; ++r) {
+        const float* w = model->weights + (size_t)r * h->num_features;
+        double sum = model->bias[r];
+        for (uint32_t f = 0; f < h->num_features; ++f) sum += (double)w[f] * z[f];
+        logits[r] = sum;
+        if (sum > max_logit) max_logit = sum;
+    }
+    if (h->logit_rows == 1) {
+        double p = 1.0 / (1.0 + exp(-logits[0]));
+        probs[0] += (float)(1.0 - p);
+        probs[1] += (float)p;
+        return;
+    }
+    double total = 0;
+    for (uint32_t c = 0; c < h->num_classes; ++c) {
+        logits[c] = exp(logits[c] - max_logit);
+        total += logits[c];
+    }
+    for (uint32_t c = 0; c < h->num_classes; ++c) probs[c] += (float)(logits[c] / total);
+}
+
+int classify_features(const classifier_t* model, const float* x, verdict_t* verdict) {
+    if (!model || !model->data || !x || !verdict) return 0;
+    uint64_t start = rdtscp64();
+    const model_header_t* h = &model->header;
+    memset(verdict->probs, 0, sizeof(verdict->probs));
+
+    int models = 0;
+    if (h->num_trees) {
+        forest_probs(model, x, verdict->probs);
+        models++;
+    }
+    if (h->logit_rows) {
+        logistic_probs(model, x, verdict->probs);
+        models++;
+    }
+    verdict->label = 0;
+    for (uint32_t c = 0; c < h->num_classes; ++c) {
+        verdict->probs[c] /= (float)models;
+        if (verdict->probs[c] > verdict->probs[verdict->label]) verdict->label = (int)c;
+    }
+    verdict->cycles = rdtscp64() - start;
+    return 1;
+}
+
+int classify_round(const classifier_t* model, const memorygrammer_t* mg, verdict_t* verdict) {
+    if (!model || !mg || !verdict || mg->num_samples == 0) return 0;
+    uint64_t start = rdtscp64();
+    feature_record_t record;
+    if (mg->features) {
+        feature_finish(mg->features, &record);
+    } else {
+        // No streaming features: one pass over the kept samples
+        feature_extractor_t fx;
+        feature_init(&fx, 0, mg->config->timer.tsc_hz);
+        uint64_t first = mg->start_tsc[sample_index(mg, 0)];
+        uint64_t last = mg->start_tsc[sample_index(mg, mg->num_samples - 1)];
+        fx.band_cycles = (last - first) / FEATURE_BANDS + 1;
+        for (size_t i = 0; i < mg->num_samples; ++i) {
+            size_t idx = sample_index(mg, i);
+            feature_add(&fx, mg->timings[idx], mg->start_tsc[idx] - first);
+        }
+        feature_finish(&fx, &record);
+    }
+    float x[FEATURE_VECTOR_LEN];
+    feature_vector(&record, x);
+    if (!classify_features(model, x, verdict)) return 0;
+    verdict->cycles = rdtscp64() - start;
+    return 1;
+}
+
+const char* classifier_class_name(const classifier_t* model, int label) {
+    if (!model || !model->data || label < 0 || (uint32_t)label >= model->header.num_classes) return "?";
+    return model->class_names + (size_t)label * MODEL_CLASS_NAME_LEN;
+}
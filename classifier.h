@@ -0,0 +1,84 @@
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include <stdint.h>
+#include "memorygrammer.h"
+#include "feature-extractor.h"
+
+#define MODEL_MAGIC "MGMODEL"
+#define MODEL_VERSION 1
+#define MODEL_MAX_CLASSES 64
+#define MODEL_CLASS_NAME_LEN 32
+#define MODEL_TREE_BATCH 16     // trees walked in lockstep
+
+/**
+ * Flat model file written by data-analysis/export-model.py (little-endian):
+ *   model_header_t
+ *   char class_names[num_classes][MODEL_CLASS_NAME_LEN]
+ *   uint32_t tree_roots[num_trees]
+ *   int32_t feature[num_nodes]    (-1 for a leaf)
+ *   float threshold[num_nodes]    (go left if x <= threshold)
+ *   uint32_t left[num_nodes]      (leaf: index into leaf_probs)
+ *   uint32_t right[num_nodes]
+ *   float leaf_probs[num_leaves][num_classes]
+ *   float scale_mean[num_features], scale_std[num_features]   (logistic input standardization)
+ *   float weights[logit_rows][num_features], bias[logit_rows]
+ * Every array is padded to 8 bytes. Children always follow their parent.
+ */
+typedef struct {
+    char magic[8];              // MODEL_MAGIC
+    uint32_t version;
+    uint32_t num_features;      // Must be FEATURE_VECTOR_LEN
+    uint32_t num_classes;
+    uint32_t num_trees;         // 0 for no forest
+    uint32_t num_nodes;
+    uint32_t num_leaves;
+    uint32_t logit_rows;        // 0 for no logistic model, 1 for binary, num_classes otherwise
+    uint32_t reserved;
+} model_header_t;
+
+/**
+ * A loaded model; every array points into one buffer
+ */
+typedef struct {
+    void* data;
+    model_header_t header;
+    const char* class_names;
+    const uint32_t* tree_roots;
+    const int32_t* feature;     // Forest nodes, structure of arrays
+    const float* threshold;
+    const uint32_t* left;
+    const uint32_t* right;
+    const float* leaf_probs;
+    const float* scale_mean;
+    const float* scale_std;
+    const float* weights;
+    const float* bias;
+} classifier_t;
+
+typedef struct {
+    int label;                  // Class with the highest combined probability
+    float probs[MODEL_MAX_CLASSES];     // Mean of the forest and logistic probabilities
+    uint64_t cycles;            // Time spent classifying
+} verdict_t;
+
+/**
+ * Load and validate a model file. Returns 1 on success, 0 on failure
+ */
+int classifier_load(classifier_t* model, const char* path);
+void classifier_free(classifier_t* model);
+
+/**
+ * Classify a feature vector of FEATURE_VECTOR_LEN entries
+ */
+int classify_features(const classifier_t* model, const float* x, verdict_t* verdict);
+
+/**
+ * Classify the last probe of mg: from its streaming features when enabled,
+ * otherwise from the stored samples
+ */
+int classify_round(const classifier_t* model, const memorygrammer_t* mg, verdict_t* verdict);
+
+const char* classifier_class_name(const classifier_t* model, int label);
+
+#endif //CLASSIFIER_H
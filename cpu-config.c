@@ -51,6 +51,25 @@ int detect_LLC_size(cpu_config_t* config, FILE* memInfo) {
     return 0;
 }
 
+/**
+ * L1d (index0) and L2 (index2) sizes, only used to size the latency calibration regions
+ */
+int detect_inner_cache_sizes(cpu_config_t* config, FILE* memInfo) {
+    if (!config) return 0;
+    int size_kb;
+    memInfo = fopen("/sys/devices/system/cpu/cpu0/cache/index0/size", "r");
+    if (memInfo) {
+        if (fscanf(memInfo, "%dK", &size_kb) == 1) config->l1d_size_bytes = (size_t)size_kb * KB_NORMALIZER;
+        fclose(memInfo);
+    }
+    memInfo = fopen("/sys/devices/system/cpu/cpu0/cache/index2/size", "r");
+    if (memInfo) {
+        if (fscanf(memInfo, "%dK", &size_kb) == 1) config->l2_size_bytes = (size_t)size_kb * KB_NORMALIZER;
+        fclose(memInfo);
+    }
+    return config->l1d_size_bytes && config->l2_size_bytes;
+}
+
 /**
  * Assumes that if it doesn't find the file so the line size is 64 bytes.
  */
@@ -130,6 +149,10 @@ int detect_cpu_config(cpu_config_t* config) {
 
     detect_line_size(config, memInfo);
 
+    if (!detect_inner_cache_sizes(config, memInfo)) {
+        printf("Failed to detect L1/L2 sizes\n");
+    }
+
     if (!check_hyperthreading(config, memInfo)) {
         printf("Failed to check hyperthreading\n");
     }
@@ -142,6 +165,20 @@ int detect_cpu_config(cpu_config_t* config) {
         printf("Failed to check huge pages\n");
     }
 
+    if (!tsc_timer_calibrate(&config->timer)) {
+        // Every interval is derived from tsc_hz, 0 would give zero-length probe windows
+        if (config->clock_speed_hz == 0) {
+            fprintf(stderr, "Failed to calibrate the TSC and no nominal clock in the model name\n");
+            return 0;
+        }
+        config->timer.tsc_hz = config->clock_speed_hz;
+        fprintf(stderr, "Failed to calibrate the TSC, assuming the nominal %.3f GHz: intervals may be off\n",
+                config->timer.tsc_hz / 1e9);
+    } else if (config->clock_speed_hz == 0 && config->timer.tsc_hz <= UINT32_MAX) {
+        // No "@ x.xxGHz" in the model name (AMD, many newer Intel parts)
+        config->clock_speed_hz = (uint32_t)config->timer.tsc_hz;
+    }
+
     size_t sliceSize = (config->llc_size_bytes)/(config->num_logical_processors);
     size_t linesInSlice = sliceSize/config->cache_line_size;
     config->sets_per_slice = linesInSlice/config->llc_associativity;
@@ -163,6 +200,16 @@ void print_cpu_config(const cpu_config_t* config) {
         printf("LLC Associativity: Unknown\n");
     }
     printf("Sets per slice: %zu sets\n", config->sets_per_slice);
+    printf("TSC: %.3f GHz (%s), rdtscp overhead %llu cycles\n", config->timer.tsc_hz / 1e9,
+           config->timer.invariant ? "invariant" : "NOT invariant",
+           (unsigned long long)config->timer.overhead_cycles);
+    if (config->latency.calibrated) {
+        const cache_latency_t* lat = &config->latency;
+        printf("Load latency: L1 %.1f, L2 %.1f, LLC %.1f, DRAM %.1f cycles (miss above %.1f)\n",
+               lat->load_cycles[LEVEL_L1], lat->load_cycles[LEVEL_L2], lat->load_cycles[LEVEL_LLC],
+               lat->load_cycles[LEVEL_DRAM], lat->miss_threshold);
+        printf("Clean sweep: %llu cycles\n", (unsigned long long)lat->clean_sweep_cycles);
+    }
     if (config->hugepages_total > 0) {
         printf("Hugepages Enabled:  Yes (Total: %d, Free: %d, Size: %zu KB)\n",
                config->hugepages_total, config->hugepages_free, config->hugepage_size_kb);
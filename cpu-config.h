@@ -2,9 +2,31 @@
 #define CPU_CONFIG_H
 #include <stddef.h>
 #include <stdint.h>
+#include "tsc-timer.h"
+
+#define LATENCY_LEVELS 4
+
+typedef enum {
+    LEVEL_L1,
+    LEVEL_L2,
+    LEVEL_LLC,
+    LEVEL_DRAM
+} cache_level_t;
+
+/**
+ * Measured access latencies, filled in by calibrate_latencies() (latency-calibration.h)
+ */
+typedef struct {
+    int calibrated;             // 0 until calibrate_latencies() ran
+    double load_cycles[LATENCY_LEVELS]; // Median cycles of a dependent load served by each level
+    double miss_threshold;      // Loads slower than this are DRAM misses, faster ones LLC hits
+    uint64_t clean_sweep_cycles;    // Median full sweep of the probe chain with nothing evicting it
+} cache_latency_t;
 
 typedef struct {
     size_t llc_size_bytes;
+    size_t l1d_size_bytes;      // 0 if unknown
+    size_t l2_size_bytes;       // 0 if unknown
     size_t cache_line_size;
     int llc_associativity;
     int num_logical_processors;
@@ -12,10 +34,12 @@ typedef struct {
     char model_name[128];
     int has_hyperthreading;
     uint32_t clock_speed_hz;
+    tsc_timer_t timer;          // Calibrated TSC timebase, use it to convert between cycles and time
     // Huge page info
     int hugepages_total;
     int hugepages_free;
     size_t hugepage_size_kb;
+    cache_latency_t latency;    // Measured, not detected: see calibrate_latencies()
 } cpu_config_t;
 
 int detect_cpu_config(cpu_config_t* config);
@@ -34,8 +34,26 @@ def analyze_csv(file_path):
 
     return avg_cycles_per_sample, avg_num_samples_per_probe
 
+def analyze_features(file_path):
+    """Same result as analyze_csv() from the per-round records in <site>.features.csv"""
+    with open(file_path, 'r') as f:
+        rows = list(csv.DictReader(f))
+    if not rows:
+        return None
+    counts = [int(row["count"]) for row in rows]
+    total = sum(counts)
+    if total == 0:
+        return None
+    avg_cycles_per_sample = sum(float(row["mean"]) * n for row, n in zip(rows, counts)) / total
+    return avg_cycles_per_sample, statistics.mean(counts)
+
+def raw_csv_files(directory):
+    # Sorted like dataset_builder's inputs, so both builders emit rows in the same order
+    return [path for path in sorted(glob.glob(os.path.join(directory, "*.csv")))
+            if not path.endswith(".features.csv")]
+
 def generate_report(directory, output_path="probe_report.txt"):
-    csv_files = glob.glob(os.path.join(directory, "*.csv"))
+    csv_files = raw_csv_files(directory)
     if not csv_files:
         print("No CSV files found.")
         return
@@ -46,7 +64,11 @@ def generate_report(directory, output_path="probe_report.txt"):
     report_lines.append("="*40)
 
     for csv_file in csv_files:
-        result = analyze_csv(csv_file)
+        # The feature records are a few lines per round, prefer them over the raw samples
+        features_file = csv_file[:-len(".csv")] + ".features.csv"
+        result = analyze_features(features_file) if os.path.exists(features_file) else None
+        if result is None:
+            result = analyze_csv(csv_file)
         if result:
             avg_cycles, avg_samples = result
             site_name = os.path.basename(csv_file)
@@ -169,12 +191,14 @@ if __name__ == "__main__":
     build_dir = "../cmake-build-debug"
     generate_report(build_dir)
 
-    csv_files = glob.glob(os.path.join(build_dir, "*.csv"))
+    csv_files = raw_csv_files(build_dir)
 
     label_mapping = {
         "bbc": 0,
         "wikipedia": 1
     }
 
+    # dataset_builder writes the same two files natively, in parallel:
+    #   dataset_builder --label bbc=0 --label wikipedia=1 ../cmake-build-debug
     build_dataset_num_samples(csv_files, label_mapping)
     build_dataset_cycles(csv_files, label_mapping)
\ No newline at end of file
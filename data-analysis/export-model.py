@@ -0,0 +1,128 @@
+"""
+Train the random forest and the logistic regression on the per-round feature
+records (<site>.features.csv) and export them in the flat format of classifier.h,
+so the probe can classify every round natively.
+
+    python export-model.py <directory with *.features.csv> [model.mgmodel]
+
+The class of a round is the site of its file; the class names are stored in the model.
+"""
+import glob
+import os
+import struct
+import sys
+
+import numpy as np
+import pandas as pd
+from sklearn.ensemble import RandomForestClassifier
+from sklearn.linear_model import LogisticRegression
+from sklearn.model_selection import train_test_split
+from sklearn.preprocessing import StandardScaler
+
+MODEL_MAGIC = b"MGMODEL\0"
+MODEL_VERSION = 1
+CLASS_NAME_LEN = 32
+FEATURE_COLUMNS = ["count", "mean", "variance", "min", "max", "p10", "p50", "p90", "slope"] + \
+                  [f"band{b}" for b in range(8)]
+
+
+def load_features(directory):
+    frames = []
+    files = sorted(glob.glob(os.path.join(directory, "*.features.csv")))
+    names = [os.path.basename(path)[:-len(".features.csv")] for path in files]
+    for label, path in enumerate(files):
+        df = pd.read_csv(path)
+        df["label"] = label
+        frames.append(df)
+    data = pd.concat(frames, ignore_index=True)
+    # The native engine sees float32 inputs, train on the same values
+    X = data[FEATURE_COLUMNS].values.astype(np.float32)
+    return X, data["label"].values, names
+
+
+def threshold_down(value):
+    """Largest float32 <= value, so float32 x <= it exactly when x <= value"""
+    t = np.float32(value)
+    if float(t) > value:
+        t = np.nextafter(t, np.float32(-np.inf))
+    return t
+
+
+def flatten_forest(forest):
+    roots, feature, threshold, left, right, leaves = [], [], [], [], [], []
+    for estimator in forest.estimators_:
+        tree = estimator.tree_
+        # Breadth-first, so children always follow their parent
+        order, position, queue = [], {}, [0]
+        while queue:
+            n = queue.pop(0)
+            position[n] = len(order)
+            order.append(n)
+            if tree.children_left[n] != -1:
+                queue += [tree.children_left[n], tree.children_right[n]]
+        base = len(feature)
+        roots.append(base)
+        for n in order:
+            if tree.children_left[n] == -1:
+                value = tree.value[n][0]
+                feature.append(-1)
+                threshold.append(np.float32(0))
+                left.append(len(leaves))
+                right.append(0)
+                leaves.append(value / value.sum())
+            else:
+                feature.append(tree.feature[n])
+                threshold.append(threshold_down(tree.threshold[n]))
+                left.append(base + position[tree.children_left[n]])
+                right.append(base + position[tree.children_right[n]])
+    return roots, feature, threshold, left, right, leaves
+
+
+def padded(array):
+    data = array.tobytes()
+    return data + b"\0" * (-len(data) % 8)
+
+
+def write_model(path, names, forest, scaler, logistic):
+    num_classes = len(names)
+    roots, feature, threshold, left, right, leaves = flatten_forest(forest)
+    rows = logistic.coef_.shape[0]
+    header = struct.pack("<8s8I", MODEL_MAGIC, MODEL_VERSION, len(FEATURE_COLUMNS), num_classes,
+                         len(roots), len(feature), len(leaves), rows, 0)
+    class_names = b"".join(name.encode()[:CLASS_NAME_LEN - 1].ljust(CLASS_NAME_LEN, b"\0") for name in names)
+    with open(path, "wb") as f:
+        f.write(header + b"\0" * (-len(header) % 8))
+        f.write(padded(np.frombuffer(class_names, dtype=np.uint8)))
+        f.write(padded(np.asarray(roots, dtype="<u4")))
+        f.write(padded(np.asarray(feature, dtype="<i4")))
+        f.write(padded(np.asarray(threshold, dtype="<f4")))
+        f.write(padded(np.asarray(left, dtype="<u4")))
+        f.write(padded(np.asarray(right, dtype="<u4")))
+        f.write(padded(np.asarray(leaves, dtype="<f4").reshape(-1)))
+        f.write(padded(scaler.mean_.astype("<f4")))
+        f.write(padded(scaler.scale_.astype("<f4")))
+        f.write(padded(logistic.coef_.astype("<f4").reshape(-1)))
+        f.write(padded(logistic.intercept_.astype("<f4")))
+    print(f"Model written to {path}: {len(roots)} trees, {len(feature)} nodes, {num_classes} classes")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    directory = sys.argv[1]
+    output = sys.argv[2] if len(sys.argv) > 2 else "model.mgmodel"
+
+    X, y, names = load_features(directory)
+    if len(names) < 2:
+        print("Need feature files of at least two sites.")
+        sys.exit(1)
+    X_train, X_test, y_train, y_test = train_test_split(X, y, test_size=0.25, random_state=42)
+
+    forest = RandomForestClassifier(n_estimators=100, random_state=42).fit(X_train, y_train)
+    scaler = StandardScaler().fit(X_train)
+    logistic = LogisticRegression(max_iter=1000, random_state=42).fit(scaler.transform(X_train), y_train)
+    print(f"Random Forest accuracy: {forest.score(X_test, y_test):.3f}")
+    print(f"Logistic Regression accuracy: {logistic.score(scaler.transform(X_test), y_test):.3f}")
+
+    write_model(output, names, forest, scaler, logistic)
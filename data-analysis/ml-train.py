@@ -1,3 +1,5 @@
+import os
+
 import pandas as pd
 import numpy as np
 from sklearn.model_selection import train_test_split
@@ -19,6 +21,20 @@ def load_dataset_cycles(path):
     y = df["label"].values
     return X, y
 
+def load_dataset_npy(prefix, pad=-1):
+    """
+    Ragged dataset written by the collector (campaign key `dataset`): the values are
+    memory-mapped, no parsing; rounds are padded only here, to the longest one.
+    """
+    values = np.load(f"{prefix}.values.npy", mmap_mode="r")
+    offsets = np.load(f"{prefix}.offsets.npy")
+    y = np.load(f"{prefix}.labels.npy")
+    lengths = np.diff(offsets)
+    X = np.full((len(y), lengths.max(initial=0)), pad, dtype=np.int64)
+    for i, (start, length) in enumerate(zip(offsets[:-1], lengths)):
+        X[i, :length] = values[start:start + length]
+    return X, y
+
 def train_and_evaluate(X, y, model_name="Random Forest"):
     X_train, X_test, y_train, y_test = train_test_split(X, y, test_size=0.25, random_state=42)
     print(f"Training samples: {len(X_train)}, Test samples: {len(X_test)}")
@@ -49,7 +65,10 @@ if __name__ == "__main__":
 
     # Load dataset 2 (cycle timings)
     print("\nTraining on dataset 2 (full cycles per probe)...")
-    X2, y2 = load_dataset_cycles("cycles_count.csv")
+    if os.path.exists("campaign.offsets.npy"):
+        X2, y2 = load_dataset_npy("campaign")
+    else:
+        X2, y2 = load_dataset_cycles("cycles_count.csv")
 
     # Optional: mask padding (-1) if necessary later
 
@@ -0,0 +1,144 @@
+import mmap
+import numpy as np
+
+# Layout mirrors trace-file.h
+CONFIG_DTYPE = np.dtype([
+    ("llc_size_bytes", "<u8"), ("cache_line_size", "<u8"), ("sets_per_slice", "<u8"),
+    ("hugepage_size_kb", "<u8"), ("tsc_hz", "<u8"), ("rdtscp_overhead", "<u8"),
+    ("llc_associativity", "<i4"), ("num_logical_processors", "<i4"), ("has_hyperthreading", "<i4"),
+    ("hugepages_total", "<i4"), ("hugepages_free", "<i4"), ("invariant_tsc", "<i4"),
+    ("clock_speed_hz", "<u4"), ("reserved", "<u4"), ("model_name", "S128"),
+])
+HEADER_DTYPE = np.dtype([
+    ("magic", "S8"), ("version", "<u4"), ("header_size", "<u4"), ("config", CONFIG_DTYPE),
+    ("interval_cycles", "<u8"), ("probe_cycles", "<u8"), ("site", "S64"),
+])
+LATENCY_DTYPE = np.dtype([
+    ("load_cycles", "<f8", 4), ("miss_threshold", "<f8"), ("clean_sweep_cycles", "<u8"),
+    ("calibrated", "<u4"), ("reserved", "<u4"),
+])  # Appended to the header by version 2 writers, check header_size
+BLOCK_DTYPE = np.dtype([
+    ("magic", "<u4"), ("columns", "<u4"), ("block_size", "<u8"), ("round", "<u8"), ("seed", "<u8"),
+    ("num_samples", "<u8"), ("timeline_start", "<u8"), ("overruns", "<u8"), ("skipped_slots", "<u8"),
+    ("num_subsets", "<u4"), ("num_segments", "<u4"),
+])
+PACKED_COLUMN_DTYPE = np.dtype([("encoding", "<u4"), ("reserved", "<u4"), ("base", "<u8"), ("bytes", "<u8")])
+INDEX_DTYPE = np.dtype([("round", "<u8"), ("offset", "<u8")])
+FOOTER_DTYPE = np.dtype([("magic", "S8"), ("num_rounds", "<u8"), ("index_offset", "<u8")])
+
+# (bit, name, element dtype, values per sample) in on-disk order
+COLUMNS = [
+    (1 << 0, "timings", "<u8", 1),
+    (1 << 1, "start_tsc", "<u8", 1),
+    (1 << 2, "slots", "<u8", 1),
+    (1 << 3, "subset_ids", "<u4", 1),
+    (1 << 4, "counters", "<u8", 4),  # llc_misses, llc_loads, dtlb_misses, instructions
+    (1 << 5, "segments", "<u4", None),  # num_segments per sample
+]
+
+
+TRACE_PACKED = 1 << 31
+TRACE_PACKABLE = 0b1111  # timings, start_tsc, slots, subset_ids
+CODEC_STREAM_VBYTE = 1
+CODEC_LEB128 = 2
+
+
+def _pad8(n):
+    return (n + 7) & ~7
+
+
+def _unzigzag_sum(z, base):
+    deltas = (z >> np.uint64(1)).astype(np.int64) ^ -(z & np.uint64(1)).astype(np.int64)
+    return (np.cumsum(deltas) + np.int64(base)).view(np.uint64)
+
+
+def decode_column(encoding, payload, n, base):
+    """Inverse of codec_encode() in sample-codec.c, vectorized."""
+    if n == 0:
+        return np.zeros(0, dtype=np.uint64)
+    if encoding == CODEC_STREAM_VBYTE:
+        groups = (n + 3) // 4
+        control = payload[:groups]
+        lengths = (((control[:, None] >> np.array([0, 2, 4, 6], dtype=np.uint8)) & 3) + 1).reshape(-1)[:n]
+        starts = groups + np.concatenate(([0], np.cumsum(lengths[:-1], dtype=np.int64)))
+        z = np.zeros(n, dtype=np.uint64)
+        for b in range(4):
+            has = lengths > b
+            z[has] |= payload[starts[has] + b].astype(np.uint64) << np.uint64(8 * b)
+    elif encoding == CODEC_LEB128:
+        ends = np.flatnonzero(payload < 0x80)[:n]  # last byte of every value
+        used = payload[:ends[-1] + 1]
+        starts = np.concatenate(([0], ends[:-1] + 1))
+        value_of_byte = np.concatenate(([0], np.cumsum(used[:-1] < 0x80)))
+        shift = (np.arange(len(used)) - starts[value_of_byte]).astype(np.uint64) * np.uint64(7)
+        z = np.add.reduceat((used & 0x7F).astype(np.uint64) << shift, starts)
+    else:
+        raise ValueError(f"unknown column encoding {encoding}")
+    return _unzigzag_sum(z, base)
+
+
+class Trace:
+    """Zero-copy view of a .mgtrace file, rounds are read straight from the mapping (packed columns are decoded)."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self._map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        self.header = np.frombuffer(self._map, HEADER_DTYPE, count=1)[0]
+        footer = np.frombuffer(self._map, FOOTER_DTYPE, count=1, offset=len(self._map) - FOOTER_DTYPE.itemsize)[0]
+        if self.header["magic"] != b"MGTRACE" or footer["magic"] != b"MGTRIDX":
+            raise ValueError(f"{path} is not a closed trace file")
+        self.index = np.frombuffer(self._map, INDEX_DTYPE, count=int(footer["num_rounds"]),
+                                   offset=int(footer["index_offset"]))
+        self.latency = None
+        if self.header["header_size"] >= HEADER_DTYPE.itemsize + LATENCY_DTYPE.itemsize:
+            latency = np.frombuffer(self._map, LATENCY_DTYPE, count=1, offset=HEADER_DTYPE.itemsize)[0]
+            self.latency = latency if latency["calibrated"] else None
+
+    def __len__(self):
+        return len(self.index)
+
+    def round(self, i):
+        """Block header fields plus one numpy array per column."""
+        offset = int(self.index[i]["offset"])
+        block = np.frombuffer(self._map, BLOCK_DTYPE, count=1, offset=offset)[0]
+        n = int(block["num_samples"])
+        result = {name: block[name].item() for name in BLOCK_DTYPE.names}
+        pos = offset + BLOCK_DTYPE.itemsize
+        packed = bool(block["columns"] & TRACE_PACKED)
+        for bit, name, dtype, width in COLUMNS:
+            if not block["columns"] & bit:
+                continue
+            if packed and bit & TRACE_PACKABLE:
+                head = np.frombuffer(self._map, PACKED_COLUMN_DTYPE, count=1, offset=pos)[0]
+                pos += PACKED_COLUMN_DTYPE.itemsize
+                payload = np.frombuffer(self._map, np.uint8, count=int(head["bytes"]), offset=pos)
+                values = decode_column(int(head["encoding"]), payload, n, int(head["base"]))
+                result[name] = values.astype(dtype)
+                pos += _pad8(int(head["bytes"]))
+                continue
+            width = int(block["num_segments"]) if width is None else width
+            count = n * width
+            values = np.frombuffer(self._map, dtype, count=count, offset=pos)
+            result[name] = values.reshape(n, width) if width > 1 else values
+            pos += _pad8(count * np.dtype(dtype).itemsize)
+        if self.latency is not None and "timings" in result:
+            result["evictions"] = self.evictions(result["timings"])
+        return result
+
+    def evictions(self, timings):
+        """Lines refetched from DRAM per sweep, as estimate_evictions() in latency-calibration.c."""
+        penalty = self.latency["load_cycles"][3] - self.latency["load_cycles"][2]
+        if penalty <= 0:
+            return np.zeros(len(timings))
+        extra = timings.astype(np.float64) - float(self.latency["clean_sweep_cycles"])
+        return np.maximum(extra, 0) / penalty
+
+
+if __name__ == "__main__":
+    import sys
+    trace = Trace(sys.argv[1])
+    print(f"Site: {trace.header['site'].decode()}  rounds: {len(trace)}")
+    for i in range(len(trace)):
+        r = trace.round(i)
+        print(f"  round {r['round']}: {r['num_samples']} samples, seed {r['seed']}, "
+              f"mean {r['timings'].mean():.0f} cycles")
@@ -0,0 +1,432 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <emmintrin.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Native replacement for build_dataset_num_samples() / build_dataset_cycles() of
+ * data-analysis/csv-analysis.py, with byte-identical output:
+ *   dataset_builder [--output dir] [--threads N] --label bbc=0 --label wikipedia=1 ... <csv files or directories>
+ * The legacy CSVs are mmap'ed and scanned 16 bytes at a time with SSE2 for line ends
+ * and commas: a probe starts at the row whose second field holds its sample count.
+ * Files are parsed in parallel, then written as sample_count.csv and cycles_count.csv.
+ */
+
+#define MAX_LABELS 64
+#define MAX_KEYWORD_LEN 64
+#define OUTPUT_BUFFER (1 << 20)
+#define ROW_END "\r\n"          // what Python's csv.writer terminates rows with
+
+typedef struct {
+    char keyword[MAX_KEYWORD_LEN];
+    int label;
+} label_rule_t;
+
+/**
+ * Probes of one CSV: values[probe_starts[p] .. probe_starts[p + 1]) is probe p
+ */
+typedef struct {
+    char* path;
+    int label;
+    uint64_t* values;
+    size_t num_values;
+    size_t values_capacity;
+    size_t* probe_starts;
+    size_t num_probes;
+    size_t probes_capacity;
+    uint64_t* sample_counts;    // Second field of every probe's first row
+    size_t num_counts;
+    size_t counts_capacity;
+    int ok;
+} csv_file_t;
+
+typedef struct {
+    csv_file_t* files;
+    size_t num_files;
+    atomic_size_t next;         // Next file to parse
+} build_job_t;
+
+static int push_u64(uint64_t** array, size_t* count, size_t* capacity, uint64_t value) {
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 4096;
+        uint64_t* data = realloc(*array, grown * sizeof(uint64_t));
+        if (!data) return 0;
+        *array = data;
+        *capacity = grown;
+    }
+    (*array)[(*count)++] = value;
+    return 1;
+}
+
+static int push_size(size_t** array, size_t* count, size_t* capacity, size_t value) {
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 256;
+        size_t* data = realloc(*array, grown * sizeof(size_t));
+        if (!data) return 0;
+        *array = data;
+        *capacity = grown;
+    }
+    (*array)[(*count)++] = value;
+    return 1;
+}
+
+/**
+ * Leading integer of a field (leading blanks skipped), 0 if there is none
+ */
+static int parse_u64(const char* p, const char* end, uint64_t* value) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p == end || *p < '0' || *p > '9') return 0;
+    uint64_t v = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) v = v * 10 + (uint64_t)(*p - '0');
+    *value = v;
+    return 1;
+}
+
+
+/**
+ * One row: "value, count" opens a probe, "value," continues it.
+ * comma is the last ',' of the row, NULL if there is none.
+ */
+static int parse_row(csv_file_t* file, const char* line, const char* end, const char* comma) {
+    uint64_t value, count;
+    if (!parse_u64(line, end, &value)) return 1; // blank rows are skipped like csv.reader does
+    int opens = comma && parse_u64(comma + 1, end, &count);
+    if (opens) {
+        if (!push_u64(&file->sample_counts, &file->num_counts, &file->counts_capacity, count)) return 0;
+    }
+    // Rows before the first count form a probe of their own
+    if (opens || file->num_probes == 0) {
+        if (!push_size(&file->probe_starts, &file->num_probes, &file->probes_capacity, file->num_values)) return 0;
+    }
+    return push_u64(&file->values, &file->num_values, &file->values_capacity, value);
+}
+
+static int parse_csv(csv_file_t* file) {
+    int fd = open(file->path, O_RDONLY);
+    if (fd < 0) {
+        perror(file->path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(file->path);
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        return 1;
+    }
+    const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(file->path);
+        return 0;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i comma = _mm_set1_epi8(',');
+    const char* line = data;
+    const char* last_comma = NULL;
+    int ok = 1;
+    size_t i = 0;
+    for (; i + 16 <= size && ok; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned nl = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        unsigned commas = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, comma));
+        unsigned events = nl | commas;
+        while (events && ok) {
+            unsigned bit = (unsigned)__builtin_ctz(events);
+            events &= events - 1;
+            const char* at = data + i + bit;
+            if (commas & (1u << bit)) {
+                last_comma = at;
+                continue;
+            }
+            ok = parse_row(file, line, at, last_comma);
+            line = at + 1;
+            last_comma = NULL;
+        }
+    }
+    // Tail shorter than a vector
+    for (; i < size && ok; ++i) {
+        if (data[i] == ',') last_comma = data + i;
+        if (data[i] != '\n') continue;
+        ok = parse_row(file, line, data + i, last_comma);
+        line = data + i + 1;
+        last_comma = NULL;
+    }
+    // Last row without a '\n'
+    if (ok && line < data + size) ok = parse_row(file, line, data + size, last_comma);
+    munmap((void*)data, size);
+    if (!ok) fprintf(stderr, "%s: out of memory\n", file->path);
+    return ok;
+}
+
+static void* parse_worker(void* arg) {
+    build_job_t* job = arg;
+    for (;;) {
+        size_t i = atomic_fetch_add(&job->next, 1);
+        if (i >= job->num_files) break;
+        if (job->files[i].label >= 0) job->files[i].ok = parse_csv(&job->files[i]);
+    }
+    return NULL;
+}
+
+/**
+ * Label of the first rule whose keyword is in the lower-cased file name, -1 if none
+ */
+static int label_of(const char* path, const label_rule_t* rules, size_t num_rules) {
+    const char* slash = strrchr(path, '/');
+    char name[256];
+    snprintf(name, sizeof(name), "%s", slash ? slash + 1 : path);
+    for (char* c = name; *c; ++c) {
+        if (*c >= 'A' && *c <= 'Z') *c = (char)(*c - 'A' + 'a');
+    }
+    for (size_t r = 0; r < num_rules; ++r) {
+        if (strstr(name, rules[r].keyword)) return rules[r].label;
+    }
+    return -1;
+}
+
+static int ends_with(const char* s, const char* suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static int add_path(char*** paths, size_t* count, size_t* capacity, const char* path) {
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 64;
+        char** data = realloc(*paths, grown * sizeof(char*));
+        if (!data) return 0;
+        *paths = data;
+        *capacity = grown;
+    }
+    char* copy = strdup(path);
+    if (!copy) return 0;
+    (*paths)[(*count)++] = copy;
+    return 1;
+}
+
+/**
+ * A file as is, or the raw probe CSVs of a directory (no *.features.csv)
+ */
+static int collect_paths(const char* path, char*** paths, size_t* count, size_t* capacity) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) return add_path(paths, count, capacity, path);
+
+    DIR* dir = opendir(path);
+    if (!dir) {
+        perror(path);
+        return 0;
+    }
+    int ok = 1;
+    struct dirent* entry;
+    while (ok && (entry = readdir(dir))) {
+        if (!ends_with(entry->d_name, ".csv") || ends_with(entry->d_name, ".features.csv")) continue;
+        char full[4096];
+        snprintf(full, sizeof(full), "%s/%s", path, entry->d_name);
+        if (stat(full, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        ok = add_path(paths, count, capacity, full);
+    }
+    closedir(dir);
+    return ok;
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * Appends the decimal digits of value to out, returns the new end
+ */
+static char* put_u64(char* out, uint64_t value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n) *out++ = digits[--n];
+    return out;
+}
+
+static int write_sample_counts(const char* path, const csv_file_t* files, size_t num_files, size_t* rows) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return 0;
+    }
+    setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER);
+    fputs("num_samples,label" ROW_END, out);
+    *rows = 0;
+    char line[64];
+    for (size_t f = 0; f < num_files; ++f) {
+        if (files[f].label < 0) continue;
+        for (size_t i = 0; i < files[f].num_counts; ++i) {
+            char* p = put_u64(line, files[f].sample_counts[i]);
+            p += sprintf(p, ",%d" ROW_END, files[f].label);
+            fwrite(line, 1, (size_t)(p - line), out);
+        }
+        *rows += files[f].num_counts;
+    }
+    return fclose(out) == 0;
+}
+
+/**
+ * One row per probe, padded with -1 to the longest probe. Timings are written the
+ * way Python prints the floats load_probes() parses them into ("41959078.0").
+ */
+static int write_cycles(const char* path, const csv_file_t* files, size_t num_files, size_t* rows, size_t* width) {
+    size_t max_len = 0;
+    for (size_t f = 0; f < num_files; ++f) {
+        if (files[f].label < 0) continue;
+        for (size_t p = 0; p < files[f].num_probes; ++p) {
+            size_t end = p + 1 < files[f].num_probes ? files[f].probe_starts[p + 1] : files[f].num_values;
+            size_t len = end - files[f].probe_starts[p];
+            if (len > max_len) max_len = len;
+        }
+    }
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return 0;
+    }
+    setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER);
+    for (size_t i = 0; i < max_len; ++i) fprintf(out, "sample_%zu,", i);
+    fputs("label" ROW_END, out);
+
+    *rows = 0;
+    char cell[32];
+    for (size_t f = 0; f < num_files; ++f) {
+        const csv_file_t* file = &files[f];
+        if (file->label < 0) continue;
+        for (size_t p = 0; p < file->num_probes; ++p) {
+            size_t start = file->probe_starts[p];
+            size_t end = p + 1 < file->num_probes ? file->probe_starts[p + 1] : file->num_values;
+            for (size_t i = start; i < end; ++i) {
+                char* c = put_u64(cell, file->values[i]);
+                memcpy(c, ".0,", 3);
+                fwrite(cell, 1, (size_t)(c + 3 - cell), out);
+            }
+            for (size_t i = end - start; i < max_len; ++i) fputs("-1,", out);
+            fprintf(out, "%d" ROW_END, file->label);
+        }
+        *rows += file->num_probes;
+    }
+    *width = max_len;
+    return fclose(out) == 0;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [--output dir] [--threads N] --label <keyword>=<label> ...\n"
+                    "          <csv file or directory> ...\n"
+                    "Rows follow the sorted input paths, like raw_csv_files() in csv-analysis.py\n", name);
+}
+
+int main(int argc, char* argv[]) {
+    const char* output_dir = ".";
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    label_rule_t rules[MAX_LABELS];
+    size_t num_rules = 0;
+    char** paths = NULL;
+    size_t num_paths = 0, paths_capacity = 0;
+    for (int i = 1; i < argc; ++i) {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--output") == 0 && has_value) output_dir = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && has_value) threads = strtol(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--label") == 0 && has_value) {
+            const char* rule = argv[++i];
+            const char* eq = strchr(rule, '=');
+            if (!eq || eq == rule || (size_t)(eq - rule) >= MAX_KEYWORD_LEN || num_rules == MAX_LABELS) {
+                fprintf(stderr, "Invalid label rule: %s\n", rule);
+                return EXIT_FAILURE;
+            }
+            label_rule_t* r = &rules[num_rules++];
+            for (size_t k = 0; k < (size_t)(eq - rule); ++k) {
+                char c = rule[k];
+                r->keyword[k] = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+            }
+            r->keyword[eq - rule] = '\0';
+            r->label = atoi(eq + 1);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else if (!collect_paths(argv[i], &paths, &num_paths, &paths_capacity)) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (num_rules == 0 || num_paths == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    qsort(paths, num_paths, sizeof(char*), compare_paths);
+
+    csv_file_t* files = calloc(num_paths, sizeof(csv_file_t));
+    if (!files) {
+        perror("Failed to allocate files");
+        return EXIT_FAILURE;
+    }
+    build_job_t job = {.files = files, .num_files = num_paths};
+    atomic_init(&job.next, 0);
+    for (size_t f = 0; f < num_paths; ++f) {
+        files[f].path = paths[f];
+        files[f].label = label_of(paths[f], rules, num_rules);
+        if (files[f].label < 0) {
+            fprintf(stderr, "Warning: Could not determine label for %s, skipping...\n", paths[f]);
+            files[f].ok = 1;
+        }
+    }
+
+    if (threads < 1) threads = 1;
+    if ((size_t)threads > num_paths) threads = (long)num_paths;
+    pthread_t* workers = calloc((size_t)threads, sizeof(pthread_t));
+    long started = 0;
+    for (; workers && started < threads - 1; ++started) {
+        if (pthread_create(&workers[started], NULL, parse_worker, &job) != 0) break;
+    }
+    parse_worker(&job);
+    for (long t = 0; t < started; ++t) pthread_join(workers[t], NULL);
+    free(workers);
+
+    int ok = 1;
+    for (size_t f = 0; f < num_paths; ++f) ok &= files[f].ok;
+    if (ok) {
+        char path[4096];
+        size_t rows, width;
+        snprintf(path, sizeof(path), "%s/sample_count.csv", output_dir);
+        ok = write_sample_counts(path, files, num_paths, &rows);
+        if (ok) printf("Dataset 1 written to %s with %zu samples.\n", path, rows);
+        snprintf(path, sizeof(path), "%s/cycles_count.csv", output_dir);
+        ok = ok && write_cycles(path, files, num_paths, &rows, &width);
+        if (ok) {
+            printf("Maximum probe length detected: %zu samples.\n", width);
+            printf("Dataset 2 written to %s with %zu probes.\n", path, rows);
+        }
+    }
+
+    for (size_t f = 0; f < num_paths; ++f) {
+        free(files[f].values);
+        free(files[f].probe_starts);
+        free(files[f].sample_counts);
+        free(paths[f]);
+    }
+    free(files);
+    free(paths);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+#include "feature-extractor.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double quantile_targets[FEATURE_QUANTILES] = {0.1, 0.5, 0.9};
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void p2_init(p2_quantile_t* est, double p) {
+    memset(est, 0, sizeof(p2_quantile_t));
+    est->p = p;
+    est->dn[1] = p / 2;
+    est->dn[2] = p;
+    est->dn[3] = (1 + p) / 2;
+    est->dn[4] = 1;
+}
+
+static double p2_parabolic(const p2_quantile_t* est, int i, double s) {
+    const double* q = est->q;
+    const double* n = est->n;
+    return q[i] + s / (n[i + 1] - n[i - 1]) *
+                  ((n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+                   (n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static void p2_add(p2_quantile_t* est, double x) {
+    double* q = est->q;
+    double* n = est->n;
+    if (est->count < 5) {
+        q[est->count++] = x;
+        if (est->count == 5) {
+            qsort(q, 5, sizeof(double), compare_double);
+            const double p = est->p;
+            for (int i = 0; i < 5; ++i) n[i] = i + 1;
+            est->np[0] = 1;
+            est->np[1] = 1 + 2 * p;
+            est->np[2] = 1 + 4 * p;
+            est->np[3] = 3 + 2 * p;
+            est->np[4] = 5;
+        }
+        return;
+    }
+    est->count++;
+
+    // Cell of x, extending the extremes if needed
+    int k;
+    if (x < q[0]) {
+        q[0] = x;
+        k = 0;
+    } else if (x >= q[4]) {
+        if (x > q[4]) q[4] = x;
+        k = 3;
+    } else {
+        for (k = 0; k < 3 && x >= q[k + 1]; ++k);
+    }
+    for (int i = k + 1; i < 5; ++i) n[i] += 1;
+    for (int i = 0; i < 5; ++i) est->np[i] += est->dn[i];
+
+    // Move the middle markers toward their desired positions
+    for (int i = 1; i < 4; ++i) {
+        double d = est->np[i] - n[i];
+        if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)) {
+            double s = d > 0 ? 1 : -1;
+            double candidate = p2_parabolic(est, i, s);
+            if (q[i - 1] < candidate && candidate < q[i + 1]) {
+                q[i] = candidate;
+            } else {
+                int j = i + (int)s;
+                q[i] += s * (q[j] - q[i]) / (n[j] - n[i]);
+            }
+            n[i] += s;
+        }
+    }
+}
+
+static double p2_value(const p2_quantile_t* est) {
+    if (est->count == 0) return 0;
+    if (est->count >= 5) return est->q[2];
+    // Too few samples for the markers: exact quantile of what we have
+    double sorted[5];
+    memcpy(sorted, est->q, est->count * sizeof(double));
+    qsort(sorted, est->count, sizeof(double), compare_double);
+    return sorted[(size_t)(est->p * (double)(est->count - 1) + 0.5)];
+}
+
+void feature_init(feature_extractor_t* fx, uint64_t band_cycles, uint64_t tsc_hz) {
+    if (!fx) return;
+    fx->band_cycles = band_cycles ? band_cycles : 1;
+    fx->tsc_hz = tsc_hz ? (double)tsc_hz : 1.0;
+    feature_reset(fx);
+}
+
+void feature_reset(feature_extractor_t* fx) {
+    if (!fx) return;
+    fx->count = 0;
+    fx->mean = fx->m2 = 0;
+    fx->min = UINT64_MAX;
+    fx->max = 0;
+    for (int i = 0; i < FEATURE_QUANTILES; ++i) p2_init(&fx->quantiles[i], quantile_targets[i]);
+    fx->mean_t = fx->m2_t = fx->c_tv = 0;
+    fx->shift = 0;
+    memset(fx->band_sum, 0, sizeof(fx->band_sum));
+    memset(fx->band_sumsq, 0, sizeof(fx->band_sumsq));
+    memset(fx->band_count, 0, sizeof(fx->band_count));
+}
+
+void feature_add(feature_extractor_t* fx, uint64_t value, uint64_t offset_cycles) {
+    const double v = (double)value;
+    const double t = (double)offset_cycles / fx->tsc_hz;
+    if (fx->count == 0) fx->shift = v;
+    fx->count++;
+    const double n = (double)fx->count;
+
+    // Welford for the value, the time, and their co-moment (the slope)
+    const double dv = v - fx->mean;
+    const double dt = t - fx->mean_t;
+    fx->mean += dv / n;
+    fx->mean_t += dt / n;
+    fx->m2 += dv * (v - fx->mean);
+    fx->m2_t += dt * (t - fx->mean_t);
+    fx->c_tv += dt * (v - fx->mean);
+
+    if (value < fx->min) fx->min = value;
+    if (value > fx->max) fx->max = value;
+    for (int i = 0; i < FEATURE_QUANTILES; ++i) p2_add(&fx->quantiles[i], v);
+
+    uint64_t band = offset_cycles / fx->band_cycles;
+    if (band >= FEATURE_BANDS) band = FEATURE_BANDS - 1;
+    const double x = v - fx->shift;
+    fx->band_sum[band] += x;
+    fx->band_sumsq[band] += x * x;
+    fx->band_count[band]++;
+}
+
+void feature_finish(const feature_extractor_t* fx, feature_record_t* record) {
+    memset(record, 0, sizeof(feature_record_t));
+    if (!fx || fx->count == 0) return;
+    record->count = fx->count;
+    record->mean = fx->mean;
+    record->variance = fx->count > 1 ? fx->m2 / (double)(fx->count - 1) : 0;
+    record->min = fx->min;
+    record->max = fx->max;
+    for (int i = 0; i < FEATURE_QUANTILES; ++i) record->quantiles[i] = p2_value(&fx->quantiles[i]);
+    record->slope = fx->m2_t > 0 ? fx->c_tv / fx->m2_t : 0;
+
+    // sum((x - mu)^2) = sumsq - 2 mu sum + n mu^2, with x and mu relative to the shift
+    const double mu = fx->mean - fx->shift;
+    for (int b = 0; b < FEATURE_BANDS; ++b) {
+        if (fx->band_count[b] == 0) continue;
+        const double n = (double)fx->band_count[b];
+        double energy = (fx->band_sumsq[b] - 2 * mu * fx->band_sum[b] + n * mu * mu) / n;
+        record->band_energy[b] = energy > 0 ? energy : 0;
+    }
+}
+
+void feature_vector(const feature_record_t* record, float* out) {
+    size_t k = 0;
+    out[k++] = (float)record->count;
+    out[k++] = (float)record->mean;
+    out[k++] = (float)record->variance;
+    out[k++] = (float)record->min;
+    out[k++] = (float)record->max;
+    for (int i = 0; i < FEATURE_QUANTILES; ++i) out[k++] = (float)record->quantiles[i];
+    out[k++] = (float)record->slope;
+    for (int b = 0; b < FEATURE_BANDS; ++b) out[k++] = (float)record->band_energy[b];
+}
+
+int feature_write_header(FILE* file) {
+    if (!file) return 0;
+    fprintf(file, "round,seed,count,mean,variance,min,max,p10,p50,p90,slope");
+    for (int b = 0; b < FEATURE_BANDS; ++b) fprintf(file, ",band%d", b);
+    return fprintf(file, "\n") > 0;
+}
+
+int feature_write_record(FILE* file, uint64_t round, uint64_t seed, const feature_record_t* record) {
+    if (!file || !record) return 0;
+    fprintf(file, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.3f,%.9g,%" PRIu64 ",%" PRIu64,
+            round, seed, record->count, record->mean, record->variance, record->min, record->max);
+    for (int i = 0; i < FEATURE_QUANTILES; ++i) fprintf(file, ",%.1f", record->quantiles[i]);
+    fprintf(file, ",%.9g", record->slope);
+    for (int b = 0; b < FEATURE_BANDS; ++b) fprintf(file, ",%.9g", record->band_energy[b]);
+    return fprintf(file, "\n") > 0;
+}
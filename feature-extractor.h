@@ -0,0 +1,84 @@
+#ifndef FEATURE_EXTRACTOR_H
+#define FEATURE_EXTRACTOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define FEATURE_BANDS 8         // fixed time windows of a round
+#define FEATURE_QUANTILES 3     // p10, p50, p90
+#define FEATURE_VECTOR_LEN (6 + FEATURE_QUANTILES + FEATURE_BANDS) // feature_vector() length
+
+/**
+ * P² streaming quantile estimator (Jain & Chlamtac): five markers, O(1) per sample
+ */
+typedef struct {
+    double p;                   // Target quantile in (0, 1)
+    double q[5];                // Marker heights
+    double n[5];                // Marker positions
+    double np[5];               // Desired marker positions
+    double dn[5];               // Desired position increments
+    uint64_t count;
+} p2_quantile_t;
+
+/**
+ * Summary of one round, written as one line of <site>.features.csv
+ */
+typedef struct {
+    uint64_t count;
+    double mean;
+    double variance;
+    uint64_t min;
+    uint64_t max;
+    double quantiles[FEATURE_QUANTILES];
+    double slope;               // Least-squares trend of the sweep time, cycles per second
+    double band_energy[FEATURE_BANDS];  // Mean squared deviation from the round mean, per time window
+} feature_record_t;
+
+/**
+ * Online per-round statistics, fed one sample at a time by the probe loops
+ */
+typedef struct feature_extractor {
+    uint64_t band_cycles;       // Width of a band, the last one takes everything after it
+    double tsc_hz;
+    uint64_t count;
+    double mean;                // Welford running mean and sum of squared deviations
+    double m2;
+    uint64_t min;
+    uint64_t max;
+    p2_quantile_t quantiles[FEATURE_QUANTILES];
+    double mean_t;              // Running mean of the sample time (s) and co-moment with the value
+    double m2_t;
+    double c_tv;
+    double shift;               // First value of the round, band sums are taken relative to it
+    double band_sum[FEATURE_BANDS];
+    double band_sumsq[FEATURE_BANDS];
+    uint64_t band_count[FEATURE_BANDS];
+} feature_extractor_t;
+
+/**
+ * band_cycles: round length / FEATURE_BANDS; tsc_hz converts sample times for the slope
+ */
+void feature_init(feature_extractor_t* fx, uint64_t band_cycles, uint64_t tsc_hz);
+
+/**
+ * Start a new round
+ */
+void feature_reset(feature_extractor_t* fx);
+
+/**
+ * Add one sample; offset_cycles is its start relative to the start of the round
+ */
+void feature_add(feature_extractor_t* fx, uint64_t value, uint64_t offset_cycles);
+
+void feature_finish(const feature_extractor_t* fx, feature_record_t* record);
+
+/**
+ * Flatten a record in the column order of the feature CSV (count ... band7),
+ * the input layout of exported models
+ */
+void feature_vector(const feature_record_t* record, float* out);
+
+int feature_write_header(FILE* file);
+int feature_write_record(FILE* file, uint64_t round, uint64_t seed, const feature_record_t* record);
+
+#endif //FEATURE_EXTRACTOR_H
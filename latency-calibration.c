@@ -0,0 +1,159 @@
+#include "latency-calibration.h"
+#include "probe-arena.h"
+#include "prng.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CALIBRATION_SEED 0x6c6174656e6379ULL
+
+static const char* const level_names[LATENCY_LEVELS] = {"l1", "l2", "llc", "dram"};
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Footprint of each level: half of it, but never below the level inside it
+ */
+static void region_sizes(const cpu_config_t* config, size_t* bytes) {
+    size_t l1 = config->l1d_size_bytes ? config->l1d_size_bytes : 32 << 10;
+    size_t l2 = config->l2_size_bytes > l1 ? config->l2_size_bytes : 8 * l1;
+    size_t llc = config->llc_size_bytes > l2 ? config->llc_size_bytes : 8 * l2;
+    bytes[LEVEL_L1] = l1 / 2;
+    bytes[LEVEL_L2] = l2 / 2 > l1 ? l2 / 2 : (l1 + l2) / 2;
+    bytes[LEVEL_LLC] = llc / 2 > l2 ? llc / 2 : (l2 + llc) / 2;
+    bytes[LEVEL_DRAM] = 2 * llc;
+}
+
+/**
+ * One circular chain through every line of [base, base + bytes) in random order,
+ * so neither the prefetchers nor the page walker help. Returns the head, NULL on failure
+ */
+static probe_node_t* link_random(uint8_t* base, size_t bytes, size_t line_size, prng_t* rng) {
+    size_t n = bytes / line_size;
+    size_t* order = malloc(n * sizeof(size_t));
+    if (!order) return NULL;
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t j = prng_bounded(rng, i + 1);
+        size_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        ((probe_node_t*)(base + order[i] * line_size))->next = (probe_node_t*)(base + order[(i + 1) % n] * line_size);
+    }
+    probe_node_t* head = (probe_node_t*)(base + order[0] * line_size);
+    free(order);
+    return head;
+}
+
+/**
+ * Times LATENCY_BATCHES batches of dependent loads; returns the median cycles per load
+ */
+static double measure_level(probe_node_t* head, size_t num_lines, uint64_t overhead, uint32_t* bins, double* batches) {
+    volatile probe_node_t* curr = head;
+    for (size_t j = 0; j < num_lines; ++j) curr = curr->next; // bring the region into its level
+    for (size_t b = 0; b < LATENCY_BATCHES; ++b) {
+        uint64_t start = rdtscp64();
+        for (size_t j = 0; j < LATENCY_BATCH_LOADS; ++j) curr = curr->next;
+        uint64_t cycles = rdtscp64() - start;
+        cycles = cycles > overhead ? cycles - overhead : 0;
+        batches[b] = (double)cycles / LATENCY_BATCH_LOADS;
+        size_t bin = (size_t)(batches[b] + 0.5);
+        bins[bin < LATENCY_HIST_BINS ? bin : LATENCY_HIST_BINS - 1]++;
+    }
+    qsort(batches, LATENCY_BATCHES, sizeof(double), compare_double);
+    return batches[LATENCY_BATCHES / 2];
+}
+
+/**
+ * The bin edge that minimizes the share of LLC batches above it plus DRAM batches below it
+ */
+static double split_threshold(const uint32_t* hit, const uint32_t* miss) {
+    double hits_below = 0, misses_below = 0;
+    double best_error = 2.0;
+    size_t best = 0;
+    for (size_t t = 0; t < LATENCY_HIST_BINS; ++t) {
+        hits_below += hit[t];
+        misses_below += miss[t];
+        double error = (LATENCY_BATCHES - hits_below) / LATENCY_BATCHES + misses_below / LATENCY_BATCHES;
+        if (error < best_error) {
+            best_error = error;
+            best = t;
+        }
+    }
+    return (double)best + 0.5;
+}
+
+int calibrate_latencies(memorygrammer_t* mg, latency_histograms_t* histograms) {
+    if (!mg || !mg->config) return 0;
+    cpu_config_t* config = mg->config;
+    latency_histograms_t* hist = histograms ? histograms : malloc(sizeof(latency_histograms_t));
+    double* batches = malloc(LATENCY_BATCHES * sizeof(double));
+    probe_arena_t arena;
+    memset(&arena, 0, sizeof(probe_arena_t));
+    int ok = hist && batches;
+    if (ok) {
+        memset(hist, 0, sizeof(latency_histograms_t));
+        region_sizes(config, hist->region_bytes);
+        // One mapping for every level, each region starts at its base
+        ok = arena_init(&arena, config, hist->region_bytes[LEVEL_DRAM]);
+    }
+
+    cache_latency_t latency;
+    memset(&latency, 0, sizeof(cache_latency_t));
+    prng_t rng;
+    prng_seed(&rng, CALIBRATION_SEED);
+    for (int level = 0; ok && level < LATENCY_LEVELS; ++level) {
+        size_t bytes = hist->region_bytes[level];
+        probe_node_t* head = link_random(arena.base, bytes, config->cache_line_size, &rng);
+        if (!head) {
+            perror("Failed to link calibration region");
+            ok = 0;
+            break;
+        }
+        latency.load_cycles[level] = measure_level(head, bytes / config->cache_line_size,
+                                                   config->timer.overhead_cycles, hist->bins[level], batches);
+    }
+    if (ok) {
+        latency.miss_threshold = split_threshold(hist->bins[LEVEL_LLC], hist->bins[LEVEL_DRAM]);
+        if (latency.load_cycles[LEVEL_DRAM] < 1.2 * latency.load_cycles[LEVEL_LLC]) {
+            fprintf(stderr, "LLC and DRAM latencies overlap (%.1f vs %.1f cycles), evictions are unreliable\n",
+                    latency.load_cycles[LEVEL_LLC], latency.load_cycles[LEVEL_DRAM]);
+        }
+        ok = benchmark_chain_counts(mg, 1, CALIBRATION_SWEEPS, &latency.clean_sweep_cycles);
+    }
+    if (ok) {
+        latency.calibrated = 1;
+        config->latency = latency;
+    } else {
+        fprintf(stderr, "Latency calibration failed.\n");
+    }
+
+    if (arena.base) arena_free(&arena);
+    free(batches);
+    if (!histograms) free(hist);
+    return ok;
+}
+
+double estimate_evictions(const cache_latency_t* latency, uint64_t sweep_cycles) {
+    if (!latency || !latency->calibrated) return 0;
+    double penalty = latency->load_cycles[LEVEL_DRAM] - latency->load_cycles[LEVEL_LLC];
+    if (penalty <= 0 || sweep_cycles <= latency->clean_sweep_cycles) return 0;
+    return (double)(sweep_cycles - latency->clean_sweep_cycles) / penalty;
+}
+
+void print_latency_histograms(const latency_histograms_t* histograms, FILE* out) {
+    if (!histograms || !out) return;
+    fprintf(out, "level,bytes,cycles,count\n");
+    for (int level = 0; level < LATENCY_LEVELS; ++level) {
+        for (size_t bin = 0; bin < LATENCY_HIST_BINS; ++bin) {
+            if (histograms->bins[level][bin] == 0) continue;
+            fprintf(out, "%s,%zu,%zu,%u\n", level_names[level], histograms->region_bytes[level], bin,
+                    histograms->bins[level][bin]);
+        }
+    }
+}
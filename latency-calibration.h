@@ -0,0 +1,44 @@
+#ifndef LATENCY_CALIBRATION_H
+#define LATENCY_CALIBRATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "cpu-config.h"
+#include "memorygrammer.h"
+
+#define LATENCY_HIST_BINS 1024  // 1-cycle bins of cycles per load, the last one also counts everything slower
+#define LATENCY_BATCH_LOADS 64  // Dependent loads timed together, so rdtscp does not drown an L1 hit
+#define LATENCY_BATCHES 16384   // Batches per level
+#define CALIBRATION_SWEEPS 5    // Full sweeps behind the clean-sweep median
+
+/**
+ * Per-level histograms of the cycles per load of every batch
+ */
+typedef struct {
+    uint32_t bins[LATENCY_LEVELS][LATENCY_HIST_BINS];
+    size_t region_bytes[LATENCY_LEVELS];    // Pointer-chase footprint used for the level
+} latency_histograms_t;
+
+/**
+ * Pointer-chase regions sized to be served by L1, L2, the LLC and DRAM, carved
+ * from a probe arena, give the load latency of every level. The LLC hit / DRAM miss
+ * threshold is the cut that misclassifies the fewest LLC and DRAM batches, and the
+ * clean sweep is the median full sweep of mg's chain. Results go to mg->config->latency.
+ * Run it before the background shuffler starts: it relinks mg's chain.
+ * histograms may be NULL.
+ */
+int calibrate_latencies(memorygrammer_t* mg, latency_histograms_t* histograms);
+
+/**
+ * Lines a sweep of sweep_cycles had to refetch from DRAM, against a clean sweep.
+ * 0 when the config is not calibrated
+ */
+double estimate_evictions(const cache_latency_t* latency, uint64_t sweep_cycles);
+
+/**
+ * Write the histograms as CSV, one "level,bytes,cycles,count" row per non-empty bin
+ */
+void print_latency_histograms(const latency_histograms_t* histograms, FILE* out);
+
+#endif //LATENCY_CALIBRATION_H
@@ -2,6 +2,12 @@
 #include "cpu-config.h"
 #include "memorygrammer.h"
 #include "utils.h"
+#include "shuffler.h"
+#include "probe-workers.h"
+#include "async-writer.h"
+#include "stream-capture.h"
+#include "campaign.h"
+#include "latency-calibration.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -9,45 +15,24 @@
 #include <fcntl.h>
 #include <sched.h>
 #include <time.h>
-#define INTERVAL_NORMALIZER 1000 // 1 -> 1sec | 1000 -> 1ms | 1000000 -> microSec
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
 #define PROBE_TIME_SEC 5 // probe time in seconds
 #define INTERVAL_PROBE_MS 2 // the interval time in ms
 #define DUMMY_TIME_SEC 1
 #define DUMMY_PROBE_MS 1
-
-void pin_to_core(int core_id) {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(core_id, &cpuset);
-    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0) {
-        perror("sched_setaffinity");
-    }
-}
-
-int open_website(const char* url) {
-    pid_t pid = fork();
-    if (pid == -1) {
-        perror("fork failed");
-        return 0;
-    }
-
-    if (pid == 0) {
-        setpgid(0, 0);
-        // Child process: open browser in incognito mode
-        pin_to_core(2);
-        execlp("google-chrome", "google-chrome",
-              "--new-window",
-              url, NULL);
-        perror("execlp failed"); // if execlp returns
-        exit(EXIT_FAILURE);
-    }
-
-    // Parent continues
-    return pid; // return child PID
-}
+#define VICTIM_CORE 2 // the browser runs here
+#define SHUFFLER_CORE 1 // background reshuffling, away from the probe (0) and the browser (2)
+#define BENCH_SWEEPS 21 // sweeps per chain count in --bench-chains
+#define MISSMAP_REGIONS 256 // regions of the --missmap occupancy map
+#define MAX_WORKERS 256
+#define STREAM_RING_RECORDS (1 << 16) // 2MB of records between the probe and the consumer
 
 int heat_cache(memorygrammer_t* mg, const uint64_t intervalCycles, const uint64_t probe_cycles) {
-    pid_t browser_pid = open_website("https://www.google.co.il/");
+    pid_t browser_pid = open_website("https://www.google.co.il/", VICTIM_CORE);
     if (browser_pid == 0) {
         free_memorygrammer(mg);
         return EXIT_FAILURE;
@@ -61,33 +46,171 @@ int heat_cache(memorygrammer_t* mg, const uint64_t intervalCycles, const uint64_
 
 
 
-int collect_data(memorygrammer_t* mg, const uint64_t intervalCycles, const uint64_t probeCycles, const char* url, int round) {
-    //parse the site name from the URL
+/**
+ * Prints the median sweep time for every chain count so the best one can be picked per machine
+ */
+int bench_chains(cpu_config_t* config) {
+    memorygrammer_t mg;
+    if (!init_memorygrammer(&mg, config)) {
+        fprintf(stderr, "Failed to initialize memorygrammer.\n");
+        return EXIT_FAILURE;
+    }
+    uint64_t cycles[MAX_CHAINS];
+    if (!benchmark_chain_counts(&mg, MAX_CHAINS, BENCH_SWEEPS, cycles)) {
+        fprintf(stderr, "Chain benchmark failed.\n");
+        free_memorygrammer(&mg);
+        return EXIT_FAILURE;
+    }
+    printf("chains, cycles_per_sweep, speedup\n");
+    for (size_t n = 0; n < MAX_CHAINS; ++n) {
+        printf("%zu, %" PRIu64 ", %.2f\n", n + 1, cycles[n], (double)cycles[0] / (double)cycles[n]);
+    }
+    free_memorygrammer(&mg);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Measures the load latency of every cache level and the clean sweep (--calibrate [histograms.csv])
+ */
+int calibrate(cpu_config_t* config, const char* histogram_path) {
+    memorygrammer_t mg;
+    if (!init_memorygrammer(&mg, config)) {
+        fprintf(stderr, "Failed to initialize memorygrammer.\n");
+        return EXIT_FAILURE;
+    }
+    latency_histograms_t* histograms = malloc(sizeof(latency_histograms_t));
+    int ok = histograms && calibrate_latencies(&mg, histograms);
+    free_memorygrammer(&mg);
+    if (ok) {
+        print_cpu_config(config);
+        FILE* out = fopen(histogram_path, "w");
+        if (out) {
+            print_latency_histograms(histograms, out);
+            fclose(out);
+            printf("Histograms written to %s\n", histogram_path);
+        } else {
+            perror("Failed to open histogram file");
+        }
+    }
+    free(histograms);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Calibrates, then probes one round in miss-map mode (--missmap [regions] [map.csv])
+ */
+int collect_missmap(cpu_config_t* config, size_t num_regions, const char* path,
+                    uint64_t intervalCycles, uint64_t probeCycles) {
+    memorygrammer_t mg;
+    if (!init_memorygrammer(&mg, config)) {
+        fprintf(stderr, "Failed to initialize memorygrammer.\n");
+        return EXIT_FAILURE;
+    }
+    if (!calibrate_latencies(&mg, NULL)) {
+        free_memorygrammer(&mg);
+        return EXIT_FAILURE;
+    }
+    print_cpu_config(config);
+    run_probe_missmap(&mg, intervalCycles, probeCycles, num_regions);
+    int ok = write_missmap_to_csv(&mg, path);
+    if (ok) {
+        printf("%zu samples x %zu regions of %zu lines written to %s\n",
+               mg.num_samples, mg.num_regions, mg.region_lines, path);
+    }
+    free_memorygrammer(&mg);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * One round probed from several cores at once (--workers 0,2,4 <url>)
+ * Writes one aligned multi-channel trace to <site>-multicore.csv
+ */
+int collect_multicore(cpu_config_t* config, char* core_list, const char* url,
+                      const uint64_t intervalCycles, const uint64_t probeCycles) {
+    int cores[MAX_WORKERS];
+    size_t num_workers = 0;
+    for (char* tok = strtok(core_list, ","); tok && num_workers < MAX_WORKERS; tok = strtok(NULL, ",")) {
+        cores[num_workers++] = atoi(tok);
+    }
+
     char site_name[128];
     parse_site_name(url, site_name, sizeof(site_name));
-    //print the site name
-    printf("Probing site: %s\n", site_name);
-    pid_t browser_pid = open_website(url);
-    if (browser_pid == 0) {
-        free_memorygrammer(mg);
+    worker_pool_t pool;
+    if (!init_worker_pool(&pool, config, cores, num_workers)) {
+        fprintf(stderr, "Failed to start probe workers.\n");
+        free_worker_pool(&pool);
         return EXIT_FAILURE;
     }
-    printf("Probing...\n");
-    run_probe(mg, intervalCycles, probeCycles);
-    printf("Done.\n");
 
+    printf("Probing site: %s from %zu cores\n", site_name, num_workers);
+    pid_t browser_pid = open_website(url, VICTIM_CORE);
+    if (browser_pid == 0) {
+        free_worker_pool(&pool);
+        return EXIT_FAILURE;
+    }
+    run_worker_round(&pool, intervalCycles, probeCycles, SCHED_DROP);
     kill(-browser_pid, SIGKILL);
     waitpid(browser_pid, NULL, 0);
 
-    // Write results to CSV
     char csv_path[256];
-    snprintf(csv_path, sizeof(csv_path), "%s.csv", site_name);
-    if (!write_timings_to_csv(mg, csv_path)) {
-        fprintf(stderr, "Failed to write CSV output.\n");
-        free_memorygrammer(mg);
+    snprintf(csv_path, sizeof(csv_path), "%s-multicore.csv", site_name);
+    int ok = write_merged_trace_to_csv(&pool, csv_path);
+    if (ok) printf("Results written to: %s\n", csv_path);
+    free_worker_pool(&pool);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static atomic_int streamStop;
+
+static void stop_stream(int sig) {
+    (void)sig;
+    atomic_store(&streamStop, 1);
+}
+
+/**
+ * Continuous capture (--stream <seconds, 0 = until Ctrl-C> <path>)
+ * Appends raw stream_record_t records to path with constant memory use
+ */
+int capture_stream(cpu_config_t* config, unsigned seconds, const char* path, const uint64_t intervalCycles) {
+    memorygrammer_t mg;
+    if (!init_memorygrammer(&mg, config)) {
+        fprintf(stderr, "Failed to initialize memorygrammer.\n");
+        return EXIT_FAILURE;
+    }
+    spsc_ring_t ring;
+    if (!spsc_init(&ring, STREAM_RING_RECORDS)) {
+        free_memorygrammer(&mg);
+        return EXIT_FAILURE;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        perror("Failed to open stream file");
+        spsc_free(&ring);
+        free_memorygrammer(&mg);
+        return EXIT_FAILURE;
+    }
+
+    stream_consumer_t consumer;
+    int consumer_core = config->num_logical_processors > SHUFFLER_CORE ? SHUFFLER_CORE : -1;
+    if (!stream_consumer_start(&consumer, &ring, fd, NULL, NULL, consumer_core)) {
+        close(fd);
+        spsc_free(&ring);
+        free_memorygrammer(&mg);
         return EXIT_FAILURE;
     }
-    printf("Results written to: %s\n", csv_path);
+
+    atomic_init(&streamStop, 0);
+    signal(SIGINT, stop_stream);
+    signal(SIGALRM, stop_stream);
+    if (seconds) alarm(seconds);
+    printf("Streaming to %s...\n", path);
+    run_probe_continuous(&mg, intervalCycles, &ring, &streamStop);
+
+    stream_consumer_stop(&consumer);
+    printf("Captured %" PRIu64 " samples, dropped %" PRIu64 "\n", consumer.consumed, ring.dropped);
+    close(fd);
+    spsc_free(&ring);
+    free_memorygrammer(&mg);
     return EXIT_SUCCESS;
 }
 
@@ -102,56 +225,39 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Failed to detect CPU configuration\n");
         return 1;
     }
-    const char* urlWiki = "https://www.wikipedia.org";
-    const char* urlBBC = "https://www.bbc.com/";
-    char site1[128];
-    char site2[128];
-    char dummySite[128];
-    parse_site_name(urlWiki, site1, sizeof(site1));
-    parse_site_name(urlBBC, site2, sizeof(site2));
-    parse_site_name("https://www.google.co.il/", dummySite, sizeof(dummySite));
-    empty_csv(site1);
-    empty_csv(site2);
-    empty_csv(dummySite);
-
-
-
-    print_cpu_config(&config);
-    const uint32_t clockSpeed = get_clock_speed_hz(&config);
-    uint64_t intervalCycles = (uint64_t)(clockSpeed / INTERVAL_NORMALIZER)* INTERVAL_PROBE_MS;
-    uint64_t probeCycles = ((uint64_t)clockSpeed * PROBE_TIME_SEC);
-
-
-    // Configure memorygrammer
-    memorygrammer_t mg;
-
-    if (!init_memorygrammer(&mg, &config)) {
-        fprintf(stderr, "Failed to initialize memorygrammer.\n");
-        return EXIT_FAILURE;
+    if (argc > 1 && strcmp(argv[1], "--bench-chains") == 0) {
+        return bench_chains(&config);
     }
-    // heat_cache(&mg, intervalCycles, probeCycles);
-    collect_data(&mg, intervalCycles, probeCycles, "https://www.google.co.il/", 0);
-
-    // collect_data(&mg, intervalCycles, probeCycles, urlBBC, 0);
-    for (int i = 0; i < 50; i++) {
-        collect_data(&mg, intervalCycles, probeCycles, urlWiki, i);
+    if (argc > 1 && strcmp(argv[1], "--calibrate") == 0) {
+        return calibrate(&config, argc > 2 ? argv[2] : "latency-histograms.csv");
     }
-    collect_data(&mg, intervalCycles, probeCycles, urlWiki, 0);
-
-    // collect_data(&mg, intervalCycles, probeCycles, urlWiki, 0);
-    for (int i = 0; i < 50; i++) {
-        collect_data(&mg, intervalCycles, probeCycles, urlBBC, 0);
+    // Exact on every machine: derived from the calibrated TSC, not the model name
+    uint64_t intervalCycles = tsc_ns_to_cycles(&config.timer, INTERVAL_PROBE_MS * NS_PER_MS);
+    uint64_t probeCycles = tsc_ns_to_cycles(&config.timer, PROBE_TIME_SEC * NS_PER_SEC);
+    if (argc > 3 && strcmp(argv[1], "--workers") == 0) {
+        return collect_multicore(&config, argv[2], argv[3], intervalCycles, probeCycles);
+    }
+    if (argc > 1 && strcmp(argv[1], "--missmap") == 0) {
+        size_t regions = argc > 2 ? (size_t)strtoull(argv[2], NULL, 10) : MISSMAP_REGIONS;
+        return collect_missmap(&config, regions ? regions : MISSMAP_REGIONS, argc > 3 ? argv[3] : "missmap.csv",
+                               intervalCycles, probeCycles);
     }
+    if (argc > 3 && strcmp(argv[1], "--stream") == 0) {
+        return capture_stream(&config, (unsigned)atoi(argv[2]), argv[3], intervalCycles);
+    }
+    // Everything else is a campaign: main [campaign file]
+    campaign_t campaign;
+    if (!load_campaign(&campaign, argc > 1 ? argv[1] : "campaign.conf")) {
+        return EXIT_FAILURE;
+    }
+    print_cpu_config(&config);
+    int ok = run_campaign(&campaign, &config);
+
     clock_gettime(CLOCK_MONOTONIC, &end);
     // Calculate elapsed time in seconds and nanoseconds
     double elapsed_time = (end.tv_sec - start.tv_sec) +
                           (end.tv_nsec - start.tv_nsec) / 1e9;
     printf("Execution time: %.9f seconds\n", elapsed_time);
-
-    // Cleanup
-    free_memorygrammer(&mg);
-
-
-    return EXIT_SUCCESS;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 
 }
\ No newline at end of file
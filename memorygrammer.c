@@ -1,41 +1,189 @@
 #include "memorygrammer.h"
 #include "utils.h"
+#include "shuffler.h"
+#include "latency-calibration.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <time.h>
+#include <inttypes.h>
 #include <unistd.h>
+#include <immintrin.h>
+#include <sys/mman.h>
 #define DEFAULT_CAPACITY 1024
 
 // Fisher-Yates shuffle to randomize node access order
-static void shuffle(probe_node_t** array, size_t n) {
-    //***************** NEED TO BE FIXED (SIZE AND STUFF) MAY BE NEED TO ADD NULLIFING THE ARRAY*****************
+static void shuffle(probe_node_t** array, size_t n, prng_t* rng) {
     if (n <= 1) return;
     for (size_t i = n - 1; i > 0; i--) {
-        size_t j = rand() % (i + 1);
+        size_t j = prng_bounded(rng, i + 1);
         probe_node_t* tmp = array[i];
         array[i] = array[j];
         array[j] = tmp;
     }
 }
 
+/**
+ * Zeroed, page-aligned per-sample column. MADV_DONTFORK keeps it out of forked victims,
+ * so a launch never write-protects the ring the probe is filling
+ */
+static void* alloc_column(size_t count, size_t size) {
+    size_t bytes = (count ? count : 1) * size;
+    void* column = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (column == MAP_FAILED) return NULL;
+#ifdef MADV_DONTFORK
+    madvise(column, bytes, MADV_DONTFORK);
+#endif
+    return column;
+}
+
+static void free_column(void* column, size_t count, size_t size) {
+    if (column) munmap(column, (count ? count : 1) * size);
+}
+
 int allocate_timing_arr(memorygrammer_t* mg) {
     if (!mg) return 0;
     mg->num_samples = 0;
-    mg->timings = calloc(DEFAULT_CAPACITY, sizeof(double));
-    if (!mg->timings) {
+    mg->total_samples = 0;
+    mg->capacity = 0;
+    return reserve_timings(mg, DEFAULT_CAPACITY);
+}
+
+int reserve_timings(memorygrammer_t* mg, size_t samples) {
+    if (!mg) return 0;
+    if (samples > MAX_SAMPLE_CAPACITY) samples = MAX_SAMPLE_CAPACITY;
+    if (mg->timings && mg->capacity >= samples) return 1;
+
+    uint64_t* timings = alloc_column(samples, sizeof(uint64_t));
+    uint64_t* start_tsc = alloc_column(samples, sizeof(uint64_t));
+    uint64_t* slots = alloc_column(samples, sizeof(uint64_t));
+    uint32_t* subset_ids = alloc_column(samples, sizeof(uint32_t));
+    if (!timings || !start_tsc || !slots || !subset_ids) {
         perror("Failed to allocate timings array");
+        free_column(timings, samples, sizeof(uint64_t));
+        free_column(start_tsc, samples, sizeof(uint64_t));
+        free_column(slots, samples, sizeof(uint64_t));
+        free_column(subset_ids, samples, sizeof(uint32_t));
         return 0;
     }
+    if (mg->perf) {
+        perf_sample_t* counters = alloc_column(samples, sizeof(perf_sample_t));
+        if (!counters) {
+            perror("Failed to allocate counters array");
+            free_column(timings, samples, sizeof(uint64_t));
+            free_column(start_tsc, samples, sizeof(uint64_t));
+            free_column(slots, samples, sizeof(uint64_t));
+            free_column(subset_ids, samples, sizeof(uint32_t));
+            return 0;
+        }
+        free_column(mg->counters, mg->capacity, sizeof(perf_sample_t));
+        mg->counters = counters;
+    }
+    free_column(mg->timings, mg->capacity, sizeof(uint64_t));
+    free_column(mg->start_tsc, mg->capacity, sizeof(uint64_t));
+    free_column(mg->slots, mg->capacity, sizeof(uint64_t));
+    free_column(mg->subset_ids, mg->capacity, sizeof(uint32_t));
+    mg->timings = timings;
+    mg->start_tsc = start_tsc;
+    mg->slots = slots;
+    mg->subset_ids = subset_ids;
+    mg->capacity = samples;
+    mg->num_samples = 0;
+    mg->total_samples = 0;
     return 1;
 }
 
+int enable_perf_counters(memorygrammer_t* mg) {
+    if (!mg) return 0;
+    if (mg->perf) return 1;
+
+    perf_counters_t* perf = malloc(sizeof(perf_counters_t));
+    if (!perf) {
+        perror("Failed to allocate perf counters");
+        return 0;
+    }
+    if (!perf_counters_open(perf)) {
+        fprintf(stderr, "Hardware counters unavailable, probing on timing only\n");
+        free(perf);
+        return 0;
+    }
+    mg->counters = alloc_column(mg->capacity, sizeof(perf_sample_t));
+    if (!mg->counters) {
+        perror("Failed to allocate counters array");
+        perf_counters_close(perf);
+        free(perf);
+        return 0;
+    }
+    mg->perf = perf;
+    return 1;
+}
+
+int enable_features(memorygrammer_t* mg, uint64_t probe_cycles) {
+    if (!mg) return 0;
+    if (!mg->features) {
+        mg->features = malloc(sizeof(feature_extractor_t));
+        if (!mg->features) {
+            perror("Failed to allocate feature extractor");
+            return 0;
+        }
+    }
+    feature_init(mg->features, probe_cycles / FEATURE_BANDS, mg->config->timer.tsc_hz);
+    return 1;
+}
+
+/**
+ * Feeds a stored sample to the feature extractor, outside the timed window
+ */
+static inline void record_features(memorygrammer_t* mg, uint64_t timing, uint64_t start) {
+    if (!mg->features) return;
+    // Same rounding as the evictions the writer puts in the CSV and the dataset
+    if (mg->feature_latency) timing = (uint64_t)(estimate_evictions(mg->feature_latency, timing) + 0.5);
+    feature_add(mg->features, timing, start - mg->timeline_start);
+}
+
+/**
+ * Snapshot of the counter group before a sweep, skipped when counters are off.
+ * Returns 0 if the read failed (multiplexed out, interrupted, short read)
+ */
+static inline int read_counters(const memorygrammer_t* mg, perf_sample_t* snapshot) {
+    return mg->perf ? perf_counters_read(mg->perf, snapshot) : 0;
+}
+
+/**
+ * Stores the counter deltas of the sweep that started at `before` at ring position pos.
+ * If either read failed the sample gets zero deltas and is counted in mg->counter_failures
+ */
+static inline void store_counter_deltas(memorygrammer_t* mg, const perf_sample_t* before, int before_ok, size_t pos) {
+    if (!mg->perf) return;
+    perf_sample_t after;
+    if (!before_ok || !perf_counters_read(mg->perf, &after)) {
+        memset(&mg->counters[pos], 0, sizeof(perf_sample_t));
+        mg->counter_failures++;
+        return;
+    }
+    for (int i = 0; i < PERF_NUM_COUNTERS; ++i) {
+        mg->counters[pos].values[i] = after.values[i] - before->values[i];
+    }
+}
+
+size_t sample_index(const memorygrammer_t* mg, size_t i) {
+    // Once the ring wrapped, the oldest kept sample sits right after the newest one
+    size_t oldest = mg->total_samples > mg->capacity ? mg->total_samples % mg->capacity : 0;
+    size_t idx = oldest + i;
+    if (idx >= mg->capacity) idx -= mg->capacity;
+    return idx;
+}
+
+uint64_t get_timing(const memorygrammer_t* mg, size_t i) {
+    return mg->timings[sample_index(mg, i)];
+}
+
 /**
  * Allocates an array of probe nodes
  */
 int allocate_nodes_arr(memorygrammer_t* mg, size_t num_nodes) {
     if (!mg) return 0;
     mg->nodes_arr = malloc(num_nodes * sizeof(probe_node_t*));
+    mg->lane_orders[0] = mg->nodes_arr;
     if (!mg->nodes_arr) {
         perror("Failed to allocate node pointer array");
         return 0;
@@ -44,16 +192,23 @@ int allocate_nodes_arr(memorygrammer_t* mg, size_t num_nodes) {
 }
 
 /**
- * Allocates a buffer for each probe node (for each line)
+ * Carves a buffer for each probe node (for each line) out of one arena mapping
  * node.next is at node[0]    =    *(probe_node_t**)
- * the rest of the allocated memory is just to fill the cache line
+ * the rest of the line is just to fill the cache line
  */
 int allocate_probe_nodes(cpu_config_t* config, memorygrammer_t* mg, size_t num_nodes) {
     if (!mg || !config) return 0;
+    if (!arena_init(&mg->arena, config, num_nodes * config->cache_line_size)) {
+        fprintf(stderr, "Failed to map probe arena\n");
+        return 0;
+    }
+    fprintf(stderr, "Probe arena: %zu KB (%s)\n", mg->arena.size / 1024,
+           mg->arena.is_hugetlb ? "hugetlb" : "4K pages + THP hint");
+
     for (size_t i = 0; i < num_nodes; ++i) {
-        probe_node_t* node = aligned_alloc(config->cache_line_size, config->cache_line_size); //allocate memory as the size of the line aligned to the line size
+        probe_node_t* node = arena_alloc(&mg->arena, config->cache_line_size, config->cache_line_size); //one line, aligned to the line size
         if (!node) {
-            perror("Failed to allocate probe_node");
+            fprintf(stderr, "Probe arena exhausted at node %zu\n", i);
             return 0;
         }
         node->next = NULL;
@@ -63,23 +218,115 @@ int allocate_probe_nodes(cpu_config_t* config, memorygrammer_t* mg, size_t num_n
 }
 
 int shuffle_linked_list(memorygrammer_t* mg, size_t num_nodes) {
-    if (!mg || !mg->nodes_arr) return 0;
+    if (!mg) return 0;
+    return shuffle_linked_list_seeded(mg, num_nodes, prng_next(&mg->seed_rng));
+}
+
+void set_shuffle_seed(memorygrammer_t* mg, uint64_t seed) {
+    if (!mg) return;
+    prng_seed(&mg->seed_rng, seed);
+}
+
+int link_lane(memorygrammer_t* mg, int lane, uint64_t seed, prng_t* rng) {
+    if (!mg || lane < 0 || lane >= NUM_LANES || !mg->lane_orders[lane] || mg->num_nodes == 0) return 0;
+    probe_node_t** order = mg->lane_orders[lane];
+    const size_t num_nodes = mg->num_nodes;
+
+    // Start from arena order so the permutation depends on the seed only
+    const size_t line_size = mg->config->cache_line_size;
+    uint8_t* slot = (uint8_t*)mg->arena.base + lane * sizeof(probe_node_t);
+    for (size_t i = 0; i < num_nodes; ++i) {
+        order[i] = (probe_node_t*)(slot + i * line_size);
+    }
 
     // Shuffle node order to randomize traversal
-    srand(time(NULL));
-    shuffle(mg->nodes_arr, num_nodes);
+    prng_seed(rng, seed);
+    shuffle(order, num_nodes, rng);
 
     // Link nodes into a circular linked list
     for (size_t i = 0; i < num_nodes - 1; ++i) {
-        mg->nodes_arr[i]->next = mg->nodes_arr[i + 1];
+        order[i]->next = order[i + 1];
     }
-    mg->nodes_arr[num_nodes - 1]->next = mg->nodes_arr[0]; // make it circular
+    order[num_nodes - 1]->next = order[0]; // make it circular
+    return 1;
+}
+
+void activate_lane(memorygrammer_t* mg, int lane, uint64_t seed) {
+    mg->active_lane = lane;
+    mg->nodes_arr = mg->lane_orders[lane];
     mg->head = mg->nodes_arr[0]; // set head to the first node
+    mg->seed = seed;
+    mg->num_subsets = 0; // sub-chains belonged to the previous chain
+}
+
+int shuffle_linked_list_seeded(memorygrammer_t* mg, size_t num_nodes, uint64_t seed) {
+    if (!mg || !mg->nodes_arr || num_nodes == 0 || num_nodes != mg->num_nodes) return 0;
+    if (!link_lane(mg, mg->active_lane, seed, &mg->rng)) return 0;
+    activate_lane(mg, mg->active_lane, seed);
     return 1;
+}
 
+int next_permutation(memorygrammer_t* mg) {
+    if (!mg) return 0;
+    if (mg->shuffler) {
+        return background_swap(mg);
+    }
+    return shuffle_linked_list(mg, mg->num_nodes);
 }
 
 
+/**
+ * Cache-set index of a node, computed from its (virtual) line address
+ */
+static size_t node_set_index(const memorygrammer_t* mg, const probe_node_t* node) {
+    size_t sets = mg->config->sets_per_slice ? mg->config->sets_per_slice : 1;
+    return ((uintptr_t)node / mg->config->cache_line_size) % sets;
+}
+
+int build_subset_chains(memorygrammer_t* mg, size_t num_subsets, subset_split_t split) {
+    if (!mg || !mg->nodes_arr || num_subsets == 0 || num_subsets > mg->num_nodes) return 0;
+
+    free(mg->subset_heads);
+    free(mg->subset_lens);
+    mg->num_subsets = 0;
+    mg->subset_heads = calloc(num_subsets, sizeof(probe_node_t*));
+    mg->subset_lens = calloc(num_subsets, sizeof(size_t));
+    probe_node_t** tails = calloc(num_subsets, sizeof(probe_node_t*));
+    if (!mg->subset_heads || !mg->subset_lens || !tails) {
+        perror("Failed to allocate sub-chains");
+        free(tails);
+        return 0;
+    }
+
+    // Append every node to the tail of its sub-chain, keeping the shuffled order inside each one
+    for (size_t i = 0; i < mg->num_nodes; ++i) {
+        probe_node_t* node = mg->nodes_arr[i];
+        size_t k = split == SUBSET_BY_SET_INDEX
+                       ? node_set_index(mg, node) % num_subsets
+                       : i * num_subsets / mg->num_nodes;
+        if (tails[k]) {
+            tails[k]->next = node;
+        } else {
+            mg->subset_heads[k] = node;
+        }
+        tails[k] = node;
+        mg->subset_lens[k]++;
+    }
+
+    for (size_t k = 0; k < num_subsets; ++k) {
+        if (!tails[k]) {
+            fprintf(stderr, "Sub-chain %zu is empty, use fewer subsets\n", k);
+            free(tails);
+            shuffle_linked_list(mg, mg->num_nodes);
+            return 0;
+        }
+        tails[k]->next = mg->subset_heads[k]; // make it circular
+    }
+    free(tails);
+    mg->num_subsets = num_subsets;
+    return 1;
+}
+
 
 int init_memorygrammer(memorygrammer_t* mg, cpu_config_t* config) {
     if (!mg || !config) return 0;
@@ -103,6 +350,8 @@ int init_memorygrammer(memorygrammer_t* mg, cpu_config_t* config) {
         return 0;
     }
 
+    set_shuffle_seed(mg, prng_random_seed());
+
     if (!shuffle_linked_list(mg, num_nodes)) {
         return 0;
     }
@@ -113,66 +362,567 @@ int init_memorygrammer(memorygrammer_t* mg, cpu_config_t* config) {
 
 void reset_timings(memorygrammer_t* mg) {
     if (!mg) return;
-
-    // Free the existing timings array
-    if (mg->timings) {
-        free(mg->timings);
-        mg->timings = NULL;
-    }
-
-    // Allocate a new timings array
-    mg->timings = calloc(DEFAULT_CAPACITY, sizeof(double));
-    if (!mg->timings) {
-        perror("Failed to allocate timings array");
-        return;
-    }
-
-    // Reset the number of samples
+    // The ring is reused across rounds, only the counters start over
     mg->num_samples = 0;
+    mg->total_samples = 0;
+    mg->overruns = 0;
+    mg->skipped_slots = 0;
+    mg->probe_subsets = 1;
+    mg->probe_seed = mg->seed;
+    mg->num_segments = 0;
+    mg->num_regions = 0;
+    mg->counter_failures = 0;
+    if (mg->features) feature_reset(mg->features);
 }
 
 
 void run_probe(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles) {
     if (!mg || !mg->head || !mg->timings) return;
-    uint64_t probeLimitTime = rdtscp64() + probe_cycles;
-    size_t capacity = DEFAULT_CAPACITY;
     reset_timings(mg);
+    if (interval_cycles > 0) {
+        reserve_timings(mg, probe_cycles / interval_cycles + 1); // at most one sample per interval
+    }
+    uint64_t* timings = mg->timings;
+    const size_t capacity = mg->capacity;
+    const uint64_t overhead = mg->config->timer.overhead_cycles; // rdtscp64() pair cost, subtracted from every sample
+    size_t pos = 0;
+    size_t taken = 0;
 
+    background_wait(mg); // no lane rebuild may write the lines we are about to walk
+    mg->timeline_start = rdtscp64();
+    uint64_t probeLimitTime = mg->timeline_start + probe_cycles;
     while (rdtscp64() < probeLimitTime) {
         uint64_t t_start = rdtscp64();
         uint64_t t_target = t_start + interval_cycles;
 
         // Measure time to traverse the linked list
+        perf_sample_t counters_before;
+        int counters_ok = read_counters(mg, &counters_before); // outside the timed window
+        uint64_t traverse_start = rdtscp64();
+        volatile probe_node_t* curr = mg->head;
+        for (size_t j = 0; j < mg->num_nodes; ++j) {
+            curr = curr->next;
+        }
+        uint64_t traverse_end = rdtscp64();
+
+        // Store number of cycles it took, overwriting the oldest sample when the ring is full
+        timings[pos] = tsc_elapsed(traverse_start, traverse_end, overhead);
+        mg->start_tsc[pos] = traverse_start;
+        mg->slots[pos] = taken;
+        mg->subset_ids[pos] = 0;
+        store_counter_deltas(mg, &counters_before, counters_ok, pos);
+        record_features(mg, timings[pos], traverse_start);
+        if (++pos == capacity) pos = 0;
+        taken++;
+
+        // Busy-wait until next cycle window
+        if (traverse_end > t_target) mg->overruns++;
+        while (rdtscp64() < t_target);
+    }
+    mg->total_samples = taken;
+    mg->num_samples = taken < capacity ? taken : capacity;
+    next_permutation(mg);
+
+}
+
+void run_probe_scheduled(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles,
+                         sched_policy_t policy, uint64_t start_tsc) {
+    if (!mg || !mg->head || !mg->timings || interval_cycles == 0) return;
+    reset_timings(mg);
+    const uint64_t num_slots = probe_cycles / interval_cycles;
+    reserve_timings(mg, num_slots + 1);
+    uint64_t* timings = mg->timings;
+    const size_t capacity = mg->capacity;
+    const uint64_t overhead = mg->config->timer.overhead_cycles; // rdtscp64() pair cost, subtracted from every sample
+    size_t pos = 0;
+    size_t taken = 0;
+
+    background_wait(mg); // no lane rebuild may write the lines we are about to walk
+    const uint64_t t0 = start_tsc ? start_tsc : rdtscp64();
+    const uint64_t window_end = t0 + num_slots * interval_cycles;
+    mg->timeline_start = t0;
+    uint64_t slot = 0;
+
+    while (slot < num_slots) {
+        // Busy-wait for the slot's deadline, returns at once if we are already late
+        const uint64_t deadline = t0 + slot * interval_cycles;
+        while (rdtscp64() < deadline);
+
+        perf_sample_t counters_before;
+        int counters_ok = read_counters(mg, &counters_before); // outside the timed window
         uint64_t traverse_start = rdtscp64();
+        if (traverse_start >= window_end) break; // catch-up ran out of window
         volatile probe_node_t* curr = mg->head;
         for (size_t j = 0; j < mg->num_nodes; ++j) {
             curr = curr->next;
         }
         uint64_t traverse_end = rdtscp64();
 
-        if (mg->num_samples >= capacity) {
-            printf("ALLOCATING MORE CAPACITY\n");
-            size_t new_capacity = capacity * 2;
-            double* new_ptr = realloc(mg->timings, new_capacity * sizeof(double));
-            if (!new_ptr) {
-                fprintf(stderr, "Failed to realloc timings array\n");
-                free(mg->timings); // optional, since we're exiting
-                exit(EXIT_FAILURE);
+        timings[pos] = tsc_elapsed(traverse_start, traverse_end, overhead);
+        mg->start_tsc[pos] = traverse_start;
+        mg->slots[pos] = slot;
+        mg->subset_ids[pos] = 0;
+        store_counter_deltas(mg, &counters_before, counters_ok, pos);
+        record_features(mg, timings[pos], traverse_start);
+        if (++pos == capacity) pos = 0;
+        taken++;
+
+        uint64_t next = slot + 1;
+        if (traverse_end > t0 + next * interval_cycles) {
+            mg->overruns++;
+            if (policy == SCHED_DROP) {
+                // First slot whose start is still ahead of us
+                uint64_t ahead = (traverse_end - t0) / interval_cycles + 1;
+                if (ahead > num_slots) ahead = num_slots;
+                mg->skipped_slots += ahead - next;
+                next = ahead;
             }
-            mg->timings = new_ptr;
-            capacity = new_capacity;
         }
+        slot = next;
+    }
+    mg->skipped_slots += num_slots - slot; // slots the window closed on
+    mg->total_samples = taken;
+    mg->num_samples = taken < capacity ? taken : capacity;
+    next_permutation(mg);
+}
+void run_probe_subsets(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles,
+                       size_t num_subsets, subset_split_t split) {
+    if (!mg || !mg->head || !mg->timings) return;
+    if (!build_subset_chains(mg, num_subsets, split)) return;
+    reset_timings(mg);
+    if (interval_cycles > 0) {
+        reserve_timings(mg, probe_cycles / interval_cycles + 1);
+    }
+    uint64_t* timings = mg->timings;
+    const size_t capacity = mg->capacity;
+    const uint64_t overhead = mg->config->timer.overhead_cycles; // rdtscp64() pair cost, subtracted from every sample
+    size_t pos = 0;
+    size_t taken = 0;
+    size_t subset = 0;
+    mg->probe_subsets = num_subsets;
 
-        // Store number of cycles it took
-        mg->timings[mg->num_samples] = (double)(traverse_end - traverse_start);
-        mg->num_samples++;
+    background_wait(mg); // no lane rebuild may write the lines we are about to walk
+    mg->timeline_start = rdtscp64();
+    uint64_t probeLimitTime = mg->timeline_start + probe_cycles;
+    while (rdtscp64() < probeLimitTime) {
+        uint64_t t_target = rdtscp64() + interval_cycles;
+        const size_t len = mg->subset_lens[subset];
 
-        // Busy-wait until next cycle window
+        perf_sample_t counters_before;
+        int counters_ok = read_counters(mg, &counters_before); // outside the timed window
+        uint64_t traverse_start = rdtscp64();
+        volatile probe_node_t* curr = mg->subset_heads[subset];
+        for (size_t j = 0; j < len; ++j) {
+            curr = curr->next;
+        }
+        uint64_t traverse_end = rdtscp64();
+
+        timings[pos] = tsc_elapsed(traverse_start, traverse_end, overhead);
+        mg->start_tsc[pos] = traverse_start;
+        mg->slots[pos] = taken;
+        mg->subset_ids[pos] = (uint32_t)subset;
+        store_counter_deltas(mg, &counters_before, counters_ok, pos);
+        record_features(mg, timings[pos], traverse_start);
+        if (++pos == capacity) pos = 0;
+        taken++;
+        if (++subset == num_subsets) subset = 0; // rotate to the next sub-chain
+
+        if (traverse_end > t_target) mg->overruns++;
         while (rdtscp64() < t_target);
     }
+    mg->total_samples = taken;
+    mg->num_samples = taken < capacity ? taken : capacity;
+    next_permutation(mg);
+}
+
+/**
+ * Lockstep walk of `num_chains` chains; with a constant num_chains (see traverse_chains)
+ * the cursors stay in registers and the loads of one step are independent.
+ */
+static inline __attribute__((always_inline))
+uintptr_t walk_chains(probe_node_t* const* heads, size_t steps, const size_t num_chains) {
+    probe_node_t* curr[MAX_CHAINS];
+    for (size_t k = 0; k < num_chains; ++k) {
+        curr[k] = heads[k];
+    }
+    for (size_t j = 0; j < steps; ++j) {
+        for (size_t k = 0; k < num_chains; ++k) {
+            curr[k] = curr[k]->next;
+        }
+    }
+    // Fold the cursors so the loads can't be optimized away
+    uintptr_t sink = 0;
+    for (size_t k = 0; k < num_chains; ++k) {
+        sink ^= (uintptr_t)curr[k];
+    }
+    return sink;
+}
+
+#define WALK_CASE(n) case n: return walk_chains(heads, steps, n);
+
+/**
+ * Dispatch to a walk specialized for the chain count
+ */
+static uintptr_t traverse_chains(probe_node_t* const* heads, size_t num_chains, size_t steps) {
+    switch (num_chains) {
+        WALK_CASE(1) WALK_CASE(2) WALK_CASE(3) WALK_CASE(4)
+        WALK_CASE(5) WALK_CASE(6) WALK_CASE(7) WALK_CASE(8)
+        WALK_CASE(9) WALK_CASE(10) WALK_CASE(11) WALK_CASE(12)
+        WALK_CASE(13) WALK_CASE(14) WALK_CASE(15) WALK_CASE(16)
+        default: return 0;
+    }
+}
+
+/**
+ * Steps needed so every chain is walked completely (chains differ by at most one node)
+ */
+static size_t longest_chain(const memorygrammer_t* mg) {
+    size_t steps = 0;
+    for (size_t k = 0; k < mg->num_subsets; ++k) {
+        if (mg->subset_lens[k] > steps) steps = mg->subset_lens[k];
+    }
+    return steps;
+}
+
+void run_probe_multichain(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles,
+                          size_t num_chains) {
+    if (!mg || !mg->head || !mg->timings) return;
+    if (num_chains == 0 || num_chains > MAX_CHAINS) {
+        fprintf(stderr, "Chain count must be between 1 and %d\n", MAX_CHAINS);
+        return;
+    }
+    if (!build_subset_chains(mg, num_chains, SUBSET_BY_ORDER)) return;
+    reset_timings(mg);
+    if (interval_cycles > 0) {
+        reserve_timings(mg, probe_cycles / interval_cycles + 1);
+    }
+    uint64_t* timings = mg->timings;
+    const size_t capacity = mg->capacity;
+    const uint64_t overhead = mg->config->timer.overhead_cycles; // rdtscp64() pair cost, subtracted from every sample
+    const size_t steps = longest_chain(mg);
+    size_t pos = 0;
+    size_t taken = 0;
+    volatile uintptr_t sink = 0;
+
+    background_wait(mg); // no lane rebuild may write the lines we are about to walk
+    mg->timeline_start = rdtscp64();
+    uint64_t probeLimitTime = mg->timeline_start + probe_cycles;
+    while (rdtscp64() < probeLimitTime) {
+        uint64_t t_target = rdtscp64() + interval_cycles;
+
+        perf_sample_t counters_before;
+        int counters_ok = read_counters(mg, &counters_before); // outside the timed window
+        uint64_t traverse_start = rdtscp64();
+        sink ^= traverse_chains(mg->subset_heads, num_chains, steps);
+        uint64_t traverse_end = rdtscp64();
+
+        timings[pos] = tsc_elapsed(traverse_start, traverse_end, overhead);
+        mg->start_tsc[pos] = traverse_start;
+        mg->slots[pos] = taken;
+        mg->subset_ids[pos] = 0;
+        store_counter_deltas(mg, &counters_before, counters_ok, pos);
+        record_features(mg, timings[pos], traverse_start);
+        if (++pos == capacity) pos = 0;
+        taken++;
+
+        if (traverse_end > t_target) mg->overruns++;
+        while (rdtscp64() < t_target);
+    }
+    (void)sink;
+    mg->total_samples = taken;
+    mg->num_samples = taken < capacity ? taken : capacity;
+    next_permutation(mg);
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+int benchmark_chain_counts(memorygrammer_t* mg, size_t max_chains, size_t sweeps, uint64_t* cycles_per_sweep) {
+    if (!mg || !mg->nodes_arr || !cycles_per_sweep || sweeps == 0) return 0;
+    if (max_chains > MAX_CHAINS) max_chains = MAX_CHAINS;
+
+    uint64_t* runs = malloc(sweeps * sizeof(uint64_t));
+    if (!runs) {
+        perror("Failed to allocate benchmark buffer");
+        return 0;
+    }
+    volatile uintptr_t sink = 0;
+
+    for (size_t n = 1; n <= max_chains; ++n) {
+        if (!build_subset_chains(mg, n, SUBSET_BY_ORDER)) {
+            free(runs);
+            return 0;
+        }
+        const size_t steps = longest_chain(mg);
+        sink ^= traverse_chains(mg->subset_heads, n, steps); // warm-up sweep
+
+        for (size_t r = 0; r < sweeps; ++r) {
+            uint64_t start = rdtscp64();
+            sink ^= traverse_chains(mg->subset_heads, n, steps);
+            runs[r] = tsc_elapsed(start, rdtscp64(), mg->config->timer.overhead_cycles);
+        }
+        qsort(runs, sweeps, sizeof(uint64_t), compare_u64);
+        cycles_per_sweep[n - 1] = runs[sweeps / 2];
+    }
+    (void)sink;
+    free(runs);
     shuffle_linked_list(mg, mg->num_nodes);
+    return 1;
+}
+
+/**
+ * Picks M from the timer cost and the measured per-node cost, then sizes the matrix
+ */
+static int setup_segments(memorygrammer_t* mg, double overhead_budget) {
+    if (overhead_budget <= 0) overhead_budget = 0.01;
+
+    // One sweep to warm up, one to measure the per-node cost
+    volatile probe_node_t* curr = mg->head;
+    for (size_t j = 0; j < mg->num_nodes; ++j) curr = curr->next;
+    uint64_t start = rdtscp64();
+    curr = mg->head;
+    for (size_t j = 0; j < mg->num_nodes; ++j) curr = curr->next;
+    double node_cycles = (double)(rdtscp64() - start) / (double)mg->num_nodes;
+
+    double timer_cycles = (double)mg->config->timer.overhead_cycles + 1;
+    size_t m = (size_t)(timer_cycles / (overhead_budget * node_cycles)) + 1;
+    if (m > mg->num_nodes) m = mg->num_nodes;
+
+    // Coarsen the segments until the matrix fits the memory bound
+    size_t num_segments = (mg->num_nodes + m - 1) / m;
+    while ((size_t)mg->capacity * num_segments * sizeof(uint32_t) > MAX_SEGMENT_MATRIX_BYTES && m < mg->num_nodes) {
+        m *= 2;
+        if (m > mg->num_nodes) m = mg->num_nodes;
+        num_segments = (mg->num_nodes + m - 1) / m;
+    }
+
+    free(mg->segments);
+    mg->segments = calloc(mg->capacity * num_segments, sizeof(uint32_t));
+    if (!mg->segments) {
+        perror("Failed to allocate segment matrix");
+        mg->num_segments = 0;
+        return 0;
+    }
+    mg->segment_nodes = m;
+    mg->num_segments = num_segments;
+    return 1;
+}
+
+void run_probe_segmented(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles,
+                         double overhead_budget) {
+    if (!mg || !mg->head || !mg->timings) return;
+    reset_timings(mg);
+    if (interval_cycles > 0) {
+        reserve_timings(mg, probe_cycles / interval_cycles + 1);
+    }
+    if (!setup_segments(mg, overhead_budget)) return;
+    uint64_t* timings = mg->timings;
+    const size_t capacity = mg->capacity;
+    const uint64_t overhead = mg->config->timer.overhead_cycles; // rdtscp64() pair cost, subtracted from every sample
+    const size_t num_segments = mg->num_segments;
+    const size_t m = mg->segment_nodes;
+    size_t pos = 0;
+    size_t taken = 0;
+
+    background_wait(mg); // no lane rebuild may write the lines we are about to walk
+    mg->timeline_start = rdtscp64();
+    uint64_t probeLimitTime = mg->timeline_start + probe_cycles;
+    while (rdtscp64() < probeLimitTime) {
+        uint64_t t_target = rdtscp64() + interval_cycles;
+        uint32_t* row = mg->segments + pos * num_segments;
+
+        perf_sample_t counters_before;
+        int counters_ok = read_counters(mg, &counters_before); // outside the timed window
+        uint64_t traverse_start = rdtscp64();
+        uint64_t segment_start = traverse_start;
+        volatile probe_node_t* curr = mg->head;
+        size_t j = 0;
+        uint64_t sweep = 0;
+        for (size_t seg = 0; seg < num_segments; ++seg) {
+            size_t end = j + m < mg->num_nodes ? j + m : mg->num_nodes;
+            for (; j < end; ++j) {
+                curr = curr->next;
+            }
+            uint64_t now = rdtscp64();
+            row[seg] = (uint32_t)tsc_elapsed(segment_start, now, overhead);
+            sweep += row[seg];
+            segment_start = now;
+        }
+        uint64_t traverse_end = segment_start;
+
+        // Every segment paid for its own rdtscp64(), the sweep is the sum of the corrected segments
+        timings[pos] = sweep;
+        mg->start_tsc[pos] = traverse_start;
+        mg->slots[pos] = taken;
+        mg->subset_ids[pos] = 0;
+        store_counter_deltas(mg, &counters_before, counters_ok, pos);
+        record_features(mg, timings[pos], traverse_start);
+        if (++pos == capacity) pos = 0;
+        taken++;
 
+        if (traverse_end > t_target) mg->overruns++;
+        while (rdtscp64() < t_target);
+    }
+    mg->total_samples = taken;
+    mg->num_samples = taken < capacity ? taken : capacity;
+    next_permutation(mg);
 }
+
+/**
+ * Sizes the regions and allocates the bitmap and the [capacity x num_regions] map
+ */
+static int setup_missmap(memorygrammer_t* mg, size_t num_regions) {
+    if (num_regions == 0) num_regions = 1;
+    const size_t requested = num_regions;
+    size_t lines = (mg->num_nodes + num_regions - 1) / num_regions;
+    lines = (lines + MISSMAP_REGION_ALIGN - 1) / MISSMAP_REGION_ALIGN * MISSMAP_REGION_ALIGN;
+    if (lines > MAX_REGION_LINES) lines = MAX_REGION_LINES;
+    num_regions = (mg->num_nodes + lines - 1) / lines;
+
+    // Coarsen the regions until the map fits the memory bound
+    while ((size_t)mg->capacity * num_regions * sizeof(uint16_t) > MAX_SEGMENT_MATRIX_BYTES && lines < MAX_REGION_LINES) {
+        lines *= 2;
+        if (lines > MAX_REGION_LINES) lines = MAX_REGION_LINES;
+        num_regions = (mg->num_nodes + lines - 1) / lines;
+    }
+
+    // Padding bits past the last line stay clear, so the last region needs no special case
+    free(mg->miss_bitmap);
+    free(mg->region_misses);
+    mg->miss_bitmap = calloc(num_regions * lines / 64, sizeof(uint64_t));
+    mg->region_misses = calloc(mg->capacity * num_regions, sizeof(uint16_t));
+    if (!mg->miss_bitmap || !mg->region_misses) {
+        perror("Failed to allocate miss map");
+        free(mg->miss_bitmap);
+        mg->miss_bitmap = NULL;
+        mg->num_regions = 0;
+        return 0;
+    }
+    if (num_regions != requested) {
+        fprintf(stderr, "Miss map: %zu regions of %zu lines instead of %zu requested\n", num_regions, lines,
+                requested);
+    }
+    mg->region_lines = lines;
+    mg->num_regions = num_regions;
+    return 1;
+}
+
+static inline __attribute__((always_inline))
+void count_regions_words(const uint64_t* bitmap, size_t num_regions, size_t region_words, uint16_t* counts) {
+    for (size_t r = 0; r < num_regions; ++r) {
+        const uint64_t* p = bitmap + r * region_words;
+        uint32_t count = 0;
+        for (size_t w = 0; w < region_words; ++w) count += (uint32_t)__builtin_popcountll(p[w]);
+        counts[r] = (uint16_t)count;
+    }
+}
+
+static void count_regions_scalar(const uint64_t* bitmap, size_t num_regions, size_t region_words, uint16_t* counts) {
+    count_regions_words(bitmap, num_regions, region_words, counts);
+}
+
+__attribute__((target("popcnt")))
+static void count_regions_popcnt(const uint64_t* bitmap, size_t num_regions, size_t region_words, uint16_t* counts) {
+    count_regions_words(bitmap, num_regions, region_words, counts);
+}
+
+/**
+ * Nibble lookup with pshufb, then psadbw sums the byte counts into 4 64-bit lanes.
+ * region_words is a multiple of 4 (MISSMAP_REGION_ALIGN bits)
+ */
+__attribute__((target("avx2")))
+static void count_regions_avx2(const uint64_t* bitmap, size_t num_regions, size_t region_words, uint16_t* counts) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    for (size_t r = 0; r < num_regions; ++r) {
+        const uint64_t* p = bitmap + r * region_words;
+        __m256i acc = zero;
+        for (size_t w = 0; w < region_words; w += 4) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p + w));
+            __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+            __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), zero));
+        }
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        counts[r] = (uint16_t)(_mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1));
+    }
+}
+
+void run_probe_missmap(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles, size_t num_regions) {
+    if (!mg || !mg->head || !mg->timings) return;
+    reset_timings(mg);
+    if (!mg->config->latency.calibrated) {
+        fprintf(stderr, "Miss-map probing needs a calibrated miss threshold, run calibrate_latencies() first.\n");
+        return;
+    }
+    if (interval_cycles > 0) {
+        reserve_timings(mg, probe_cycles / interval_cycles + 1);
+    }
+    if (!setup_missmap(mg, num_regions)) return;
+    void (*count_regions)(const uint64_t*, size_t, size_t, uint16_t*) =
+        __builtin_cpu_supports("avx2") ? count_regions_avx2 :
+        __builtin_cpu_supports("popcnt") ? count_regions_popcnt : count_regions_scalar;
+    uint64_t* timings = mg->timings;
+    uint64_t* bitmap = mg->miss_bitmap;
+    const size_t capacity = mg->capacity;
+    const uint64_t overhead = mg->config->timer.overhead_cycles; // rdtscp64() pair cost, subtracted from every sample
+    // Every load is timed on its own: a miss is a TSC delta above threshold + timer cost
+    const uint64_t threshold = (uint64_t)mg->config->latency.miss_threshold + overhead;
+    const uint64_t timer_cycles = mg->num_nodes * overhead;
+    const uintptr_t base = (uintptr_t)mg->arena.base;
+    const unsigned line_shift = (unsigned)__builtin_ctzll(mg->config->cache_line_size);
+    const size_t regions = mg->num_regions;
+    const size_t region_words = mg->region_lines / 64;
+    const size_t bitmap_bytes = regions * region_words * sizeof(uint64_t);
+    size_t pos = 0;
+    size_t taken = 0;
+
+    background_wait(mg); // no lane rebuild may write the lines we are about to walk
+    mg->timeline_start = rdtscp64();
+    uint64_t probeLimitTime = mg->timeline_start + probe_cycles;
+    while (rdtscp64() < probeLimitTime) {
+        uint64_t t_target = rdtscp64() + interval_cycles;
+        memset(bitmap, 0, bitmap_bytes);
+
+        perf_sample_t counters_before;
+        int counters_ok = read_counters(mg, &counters_before); // outside the timed window
+        uint64_t traverse_start = rdtscp64();
+        uint64_t prev = traverse_start;
+        volatile probe_node_t* curr = mg->head;
+        for (size_t j = 0; j < mg->num_nodes; ++j) {
+            curr = curr->next;
+            uint64_t now = rdtscp64(); // waits for the load above
+            size_t line = ((uintptr_t)curr - base) >> line_shift;
+            bitmap[line >> 6] |= (uint64_t)(now - prev > threshold) << (line & 63);
+            prev = now;
+        }
+        uint64_t traverse_end = prev;
+
+        // Every load paid for its own rdtscp64(): the sum of per-load deltas minus their overhead
+        uint64_t elapsed = traverse_end - traverse_start;
+        timings[pos] = elapsed > timer_cycles ? elapsed - timer_cycles : 0;
+        mg->start_tsc[pos] = traverse_start;
+        mg->slots[pos] = taken;
+        mg->subset_ids[pos] = 0;
+        store_counter_deltas(mg, &counters_before, counters_ok, pos);
+        count_regions(bitmap, regions, region_words, mg->region_misses + pos * regions);
+        record_features(mg, timings[pos], traverse_start);
+        if (++pos == capacity) pos = 0;
+        taken++;
+
+        if (traverse_end > t_target) mg->overruns++;
+        while (rdtscp64() < t_target);
+    }
+    mg->total_samples = taken;
+    mg->num_samples = taken < capacity ? taken : capacity;
+    next_permutation(mg);
+}
+
 void dummy_probe(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles) {
     if (!mg || !mg->head) return;
     uint64_t probeLimitTime = rdtscp64() + probe_cycles;
@@ -204,10 +954,92 @@ int write_timings_to_csv(memorygrammer_t* mg, const char* path) {
     for (size_t i = 0; i < mg->num_samples; ++i) {
         if (i == 0) {
             // First sample of the new probe: write timing + num_samples
-            fprintf(f, "%.0f, %zu\n", mg->timings[i], mg->num_samples);
+            fprintf(f, "%" PRIu64 ", %zu\n", get_timing(mg, i), mg->num_samples);
         } else {
             // Other samples of this probe: timing only
-            fprintf(f, "%.0f,\n", mg->timings[i]);
+            fprintf(f, "%" PRIu64 ",\n", get_timing(mg, i));
+        }
+    }
+
+    fclose(f);
+    return 1;
+}
+
+int write_segments_to_csv(memorygrammer_t* mg, const char* path) {
+    if (!mg || !mg->segments || mg->num_segments == 0 || !path) return 0;
+
+    FILE* f = fopen(path, "a");
+    if (!f) {
+        perror("Failed to open CSV file");
+        return 0;
+    }
+
+    fprintf(f, "# %zu, %zu, %zu\n", mg->num_samples, mg->num_segments, mg->segment_nodes);
+    for (size_t i = 0; i < mg->num_samples; ++i) {
+        const uint32_t* row = mg->segments + sample_index(mg, i) * mg->num_segments;
+        for (size_t seg = 0; seg < mg->num_segments; ++seg) {
+            fprintf(f, seg + 1 < mg->num_segments ? "%u," : "%u\n", row[seg]);
+        }
+    }
+
+    fclose(f);
+    return 1;
+}
+
+int write_missmap_to_csv(memorygrammer_t* mg, const char* path) {
+    if (!mg || !mg->region_misses || mg->num_regions == 0 || !path) return 0;
+
+    FILE* f = fopen(path, "a");
+    if (!f) {
+        perror("Failed to open CSV file");
+        return 0;
+    }
+
+    fprintf(f, "# %zu, %zu, %zu\n", mg->num_samples, mg->num_regions, mg->region_lines);
+    for (size_t i = 0; i < mg->num_samples; ++i) {
+        const uint16_t* row = mg->region_misses + sample_index(mg, i) * mg->num_regions;
+        for (size_t r = 0; r < mg->num_regions; ++r) {
+            fprintf(f, r + 1 < mg->num_regions ? "%u," : "%u\n", row[r]);
+        }
+    }
+
+    fclose(f);
+    return 1;
+}
+
+int write_subset_timings_to_csv(memorygrammer_t* mg, const char* path) {
+    if (!mg || !mg->timings || !path) return 0;
+
+    FILE* f = fopen(path, "a");
+    if (!f) {
+        perror("Failed to open CSV file");
+        return 0;
+    }
+
+    // Rotation totals give the coarse (whole LLC) view next to the per-subset samples
+    uint64_t rotation_total = 0;
+    size_t rotation_len = 0;
+    for (size_t i = 0; i < mg->num_samples; ++i) {
+        size_t idx = sample_index(mg, i);
+        uint32_t subset = mg->subset_ids[idx];
+        if (subset == 0) {
+            rotation_total = 0;
+            rotation_len = 0;
+        }
+        rotation_total += mg->timings[idx];
+        rotation_len++;
+
+        fprintf(f, "%" PRIu64 ", %u,", mg->timings[idx], subset);
+        // A rotation counts only if it started at subset 0 inside the kept samples
+        if (rotation_len == subset + 1 && subset + 1 == mg->probe_subsets) {
+            fprintf(f, " %" PRIu64 ",", rotation_total);
+        } else {
+            fprintf(f, ",");
+        }
+        if (i == 0) {
+            fprintf(f, " %zu\n", mg->num_samples);
+        } else {
+            fprintf(f, "\n");
         }
     }
 
@@ -218,27 +1050,59 @@ int write_timings_to_csv(memorygrammer_t* mg, const char* path) {
 void free_memorygrammer(memorygrammer_t* mg) {
     if (!mg) return;
 
-    // Free each node individually
-    if (mg->nodes_arr) {
-        for (size_t i = 0; i < mg->num_nodes; ++i) {
-            if (mg->nodes_arr[i]) {
-                free(mg->nodes_arr[i]);
-            }
-        }
-        free(mg->nodes_arr);
-        mg->nodes_arr = NULL;
+    stop_background_shuffler(mg);
+
+    // All nodes live in the arena, release it with one call
+    arena_free(&mg->arena);
+    for (int lane = 0; lane < NUM_LANES; ++lane) {
+        free(mg->lane_orders[lane]);
+        mg->lane_orders[lane] = NULL;
     }
+    mg->nodes_arr = NULL;
+
+    // Free per-sample columns
+    free_column(mg->timings, mg->capacity, sizeof(uint64_t));
+    free_column(mg->start_tsc, mg->capacity, sizeof(uint64_t));
+    free_column(mg->slots, mg->capacity, sizeof(uint64_t));
+    free_column(mg->subset_ids, mg->capacity, sizeof(uint32_t));
+    mg->timings = NULL;
+    mg->start_tsc = NULL;
+    mg->slots = NULL;
+    mg->subset_ids = NULL;
 
-    // Free timings array
-    if (mg->timings) {
-        free(mg->timings);
-        mg->timings = NULL;
+    free(mg->segments);
+    mg->segments = NULL;
+    mg->num_segments = 0;
+
+    free(mg->miss_bitmap);
+    free(mg->region_misses);
+    mg->miss_bitmap = NULL;
+    mg->region_misses = NULL;
+    mg->num_regions = 0;
+
+    free(mg->features);
+    mg->features = NULL;
+
+    if (mg->perf) {
+        perf_counters_close(mg->perf);
+        free(mg->perf);
+        mg->perf = NULL;
     }
+    free_column(mg->counters, mg->capacity, sizeof(perf_sample_t));
+    mg->counters = NULL;
+
+    free(mg->subset_heads);
+    free(mg->subset_lens);
+    mg->subset_heads = NULL;
+    mg->subset_lens = NULL;
+    mg->num_subsets = 0;
 
     // Clear remaining fields
     mg->head = NULL;
     mg->num_nodes = 0;
+    mg->capacity = 0;
     mg->num_samples = 0;
+    mg->total_samples = 0;
     mg->config = NULL;
 }
 
@@ -2,23 +2,85 @@
 #define MEMORYGRAMMER_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "cpu-config.h"
+#include "probe-arena.h"
+#include "prng.h"
+#include "perf-counters.h"
+#include "feature-extractor.h"
+
+#define MAX_SAMPLE_CAPACITY (1 << 20) // upper bound of the timings ring, older samples get overwritten
+#define MAX_CHAINS 16 // upper bound of independent chains walked in lockstep
+#define NUM_LANES 2 // independent link sets over the same nodes (double-buffered permutations)
+#define MAX_SEGMENT_MATRIX_BYTES (256u << 20) // upper bound of the [sample x segment] matrix
+#define MISSMAP_REGION_ALIGN 256 // region length granularity in lines: one AVX2 register of the miss bitmap
+#define MAX_REGION_LINES 65280 // largest multiple of MISSMAP_REGION_ALIGN whose miss count fits uint16_t
 
 /**
  * struct that represents a probe node.
  * each node represents a line in the cache set
+ * Every line holds NUM_LANES link slots; lane k's slot sits k pointers into the line,
+ * and a lane's chain links slot to slot, so traversal code is the same for every lane.
  */
 typedef struct probe_node {
     struct probe_node* next;
 } probe_node_t;
 
+/**
+ * What run_probe_scheduled() does when a sample runs past the next slot's deadline
+ */
+typedef enum {
+    SCHED_CATCH_UP,             // Sample every missed slot back to back until the timeline is caught up
+    SCHED_DROP                  // Skip the missed slots and resume at the next slot still ahead
+} sched_policy_t;
+
+/**
+ * How build_subset_chains() partitions the nodes into sub-chains
+ */
+typedef enum {
+    SUBSET_BY_ORDER,            // K contiguous slices of the shuffled order
+    SUBSET_BY_SET_INDEX         // By cache-set index of the node address (set % K)
+} subset_split_t;
+
 typedef struct {
     cpu_config_t* config;       // Pointer to machine-specific config
-    probe_node_t** nodes_arr;       // Array of all probe nodes
+    probe_arena_t arena;        // Single mapping that backs every probe node
+    probe_node_t** nodes_arr;       // Array of all probe nodes, in the order of the active lane
+    probe_node_t** lane_orders[NUM_LANES];  // Permutation of every lane, entries point at the lane's link slot
+    int active_lane;            // Lane the probes walk
+    struct bg_shuffler* shuffler;   // Builds the inactive lane in the background, NULL when disabled
     size_t num_nodes;           // Number of nodes (cache lines)
     probe_node_t* head;         // Starting point for traversal (randomized)
-    double* timings;            // Result timings in cycles
+    prng_t seed_rng;            // Draws the seed of every shuffle
+    prng_t rng;                 // Drives the current shuffle
+    uint64_t seed;              // Seed of the currently linked permutation
+    uint64_t probe_seed;        // Seed of the permutation used by the last probe (log it with the round)
+    uint64_t* timings;          // Ring of result timings in cycles (raw TSC deltas)
+    size_t capacity;            // Number of slots in the timings ring
     size_t num_samples;         // Number of samples that exist in the timings array
+    size_t total_samples;       // Samples taken in the last probe, including overwritten ones
+    uint64_t* start_tsc;        // Per-sample TSC at traversal start (same ring layout as timings)
+    uint64_t* slots;            // Per-sample intended slot on the fixed-rate timeline
+    uint64_t timeline_start;    // TSC of slot 0 of the last probe
+    size_t overruns;            // Samples that ended after the next slot's deadline
+    size_t skipped_slots;       // Slots that were never sampled
+    uint32_t* subset_ids;       // Per-sample sub-chain that was probed (0 for full sweeps)
+    probe_node_t** subset_heads;    // Head of each sub-chain in subset mode
+    size_t* subset_lens;        // Number of nodes in each sub-chain
+    size_t num_subsets;         // Number of linked sub-chains, 0 when the full chain is linked
+    size_t probe_subsets;       // Sub-chains rotated through in the last probe (1 for full sweeps)
+    uint32_t* segments;         // [capacity x num_segments] sub-sweep durations, row = ring position
+    size_t num_segments;        // Segments per sample in the last probe, 0 if it wasn't segmented
+    size_t segment_nodes;       // Nodes walked between two TSC reads (M)
+    uint64_t* miss_bitmap;      // One bit per arena line of the sweep in progress, set when its load missed
+    uint16_t* region_misses;    // [capacity x num_regions] missed lines per region, row = ring position
+    size_t num_regions;         // Regions per sample in the last probe, 0 if it wasn't a miss-map probe
+    size_t region_lines;        // Arena lines per region (multiple of MISSMAP_REGION_ALIGN)
+    perf_counters_t* perf;      // Hardware counter group, NULL when probing on timing only
+    perf_sample_t* counters;    // Per-sample counter deltas of the sweep (only with perf enabled)
+    size_t counter_failures;    // Samples of the last probe whose counter reads failed (stored as zero deltas)
+    feature_extractor_t* features;  // Per-round statistics fed as samples arrive, NULL when disabled
+    const cache_latency_t* feature_latency; // Feed the features estimated evictions instead of cycles, NULL for cycles
 } memorygrammer_t;
 
 
@@ -35,6 +97,114 @@ int init_memorygrammer(memorygrammer_t* mg, cpu_config_t* config);
  */
 void run_probe(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles);
 
+/**
+ * Make sure the timings ring holds at least `samples` slots (capped at MAX_SAMPLE_CAPACITY).
+ * Called before probing so the timed loop never allocates.
+ */
+int reserve_timings(memorygrammer_t* mg, size_t samples);
+
+/**
+ * Open the perf_event counter group on the calling (probing) thread and record
+ * counter deltas next to every timing from now on.
+ * Returns 0 and leaves the probe on timing only if counters aren't permitted.
+ */
+int enable_perf_counters(memorygrammer_t* mg);
+
+/**
+ * Keep per-round features (feature_extractor_t) up to date while probing.
+ * probe_cycles sets the width of the time bands (probe_cycles / FEATURE_BANDS).
+ */
+int enable_features(memorygrammer_t* mg, uint64_t probe_cycles);
+
+/**
+ * Ring position of the i-th stored sample in chronological order (0 = oldest kept sample).
+ * Valid for every per-sample column (timings, start_tsc, slots).
+ */
+size_t sample_index(const memorygrammer_t* mg, size_t i);
+
+/**
+ * Returns the i-th stored sample in chronological order (0 = oldest kept sample)
+ */
+uint64_t get_timing(const memorygrammer_t* mg, size_t i);
+
+/**
+ * Samples on a fixed-rate timeline: slot k starts at start_tsc + k * interval_cycles.
+ * Every sample records its start TSC and intended slot; late samples are counted
+ * in mg->overruns and slots that were never sampled in mg->skipped_slots.
+ * start_tsc: TSC of slot 0, 0 means "now". Lets several probes share one timeline.
+ */
+void run_probe_scheduled(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles,
+                         sched_policy_t policy, uint64_t start_tsc);
+
+/**
+ * Relink the nodes into num_subsets disjoint circular sub-chains.
+ * The full chain is restored by the next shuffle_linked_list().
+ * SUBSET_BY_SET_INDEX uses virtual address bits, which only match the
+ * physical set index within a page (all of them with hugetlb backing).
+ */
+int build_subset_chains(memorygrammer_t* mg, size_t num_subsets, subset_split_t split);
+
+/**
+ * Like run_probe() but each sample walks only one sub-chain, rotating through them,
+ * so the sample rate is num_subsets times higher and every rotation covers the whole LLC.
+ * The probed sub-chain of every sample is stored in mg->subset_ids.
+ */
+void run_probe_subsets(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles,
+                       size_t num_subsets, subset_split_t split);
+
+/**
+ * Walks num_chains (1..MAX_CHAINS) independent circular chains in lockstep.
+ * Each chain covers 1/num_chains of the nodes, so one sample still touches every line,
+ * but num_chains misses are in flight at once instead of one.
+ */
+void run_probe_multichain(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles,
+                          size_t num_chains);
+
+/**
+ * Measures the median full-sweep time for every chain count 1..max_chains.
+ * cycles_per_sweep[n - 1] receives the result for n chains.
+ */
+int benchmark_chain_counts(memorygrammer_t* mg, size_t max_chains, size_t sweeps, uint64_t* cycles_per_sweep);
+
+/**
+ * Like run_probe() but reads the TSC every M nodes during the sweep and stores the
+ * sub-sweep durations in mg->segments, giving a [sample x segment] memorygram.
+ * M is the smallest node count that keeps the timer overhead below overhead_budget
+ * (fraction of the sweep time, e.g. 0.01 for 1%). The sample timing is the sum of its row,
+ * so it compares with run_probe().
+ */
+void run_probe_segmented(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles,
+                         double overhead_budget);
+
+/**
+ * Like run_probe() but times every load against the calibrated miss threshold
+ * (calibrate_latencies() first) and sets one bit per missed line in mg->miss_bitmap.
+ * Bits follow the line's place in the arena, so a region is the same lines in every round.
+ * After each sweep the bitmap is folded into mg->region_misses with AVX2 (POPCNT otherwise),
+ * giving a [sample x region] miss map. num_regions is raised until a region's count fits
+ * uint16_t and lowered until the map fits MAX_SEGMENT_MATRIX_BYTES, with a notice on stderr.
+ * The stored sweep time has the per-load timer cost taken out, comparable with run_probe().
+ */
+void run_probe_missmap(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles, size_t num_regions);
+
+/**
+ Write the miss map to a CSV file
+ A "# samples, regions, region_lines" line starts each probe, then one row of miss counts per sample
+*/
+int write_missmap_to_csv(memorygrammer_t* mg, const char* path);
+
+/**
+ Write the segment matrix to a CSV file
+ A "# samples, segments, segment_nodes" line starts each probe, then one row of segments per sample
+*/
+int write_segments_to_csv(memorygrammer_t* mg, const char* path);
+
+/**
+ Write subset timings to a CSV file
+ Row: timing, subset, rotation total (on the last sample of a full rotation), num_samples (first row only)
+*/
+int write_subset_timings_to_csv(memorygrammer_t* mg, const char* path);
+
 /**
  Write timings to a CSV file
 */
@@ -45,7 +215,38 @@ int write_timings_to_csv(memorygrammer_t* mg, const char* path);
  */
 void free_memorygrammer(memorygrammer_t* mg);
 
+/**
+ * Relink the nodes in a fresh random order; the seed is drawn from mg->seed_rng
+ */
 int shuffle_linked_list(memorygrammer_t* mg, size_t num_nodes);
 
+/**
+ * Relink the nodes in the permutation given by seed (same seed -> same chain)
+ */
+int shuffle_linked_list_seeded(memorygrammer_t* mg, size_t num_nodes, uint64_t seed);
+
+/**
+ * Restart the sequence of shuffle seeds, so a whole run can be replayed
+ */
+void set_shuffle_seed(memorygrammer_t* mg, uint64_t seed);
+
+/**
+ * Shuffle lane_orders[lane] with the given seed and link it into a circular chain
+ * using the lane's link slots. Touches nothing else in mg, so it can run on the
+ * inactive lane from another thread.
+ */
+int link_lane(memorygrammer_t* mg, int lane, uint64_t seed, prng_t* rng);
+
+/**
+ * Make `lane` (already linked with `seed`) the one the probes walk
+ */
+void activate_lane(memorygrammer_t* mg, int lane, uint64_t seed);
+
+/**
+ * Move on to a new random chain after a probe: swaps in the background lane
+ * when a shuffler runs, otherwise reshuffles the active lane in place
+ */
+int next_permutation(memorygrammer_t* mg);
+
 void dummy_probe(memorygrammer_t* mg, uint64_t interval_cycles, uint64_t probe_cycles);
 #endif //MEMORYGRAMMER_H
@@ -0,0 +1,204 @@
+#include "npy-dataset.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char npy_magic[] = "\x93NUMPY\x01\x00";
+
+static int write_all(int fd, const void* buf, size_t size, uint64_t offset) {
+    const uint8_t* p = buf;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write dataset");
+            return 0;
+        }
+        p += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 1;
+}
+
+static int read_all(int fd, void* buf, size_t size, uint64_t offset) {
+    uint8_t* p = buf;
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 1;
+}
+
+/**
+ * Rewrite the header with the current length; the dict is space-padded to NPY_HEADER_SIZE
+ */
+static int npy_commit(npy_array_t* array) {
+    char header[NPY_HEADER_SIZE];
+    memset(header, ' ', sizeof(header));
+    memcpy(header, npy_magic, 8);
+    uint16_t dict_len = NPY_HEADER_SIZE - 10;
+    header[8] = (char)(dict_len & 0xff);
+    header[9] = (char)(dict_len >> 8);
+    int n = snprintf(header + 10, dict_len, "{'descr': '%s', 'fortran_order': False, 'shape': (%" PRIu64 ",), }",
+                     array->descr, array->length);
+    header[10 + n] = ' '; // overwrite snprintf's terminator
+    header[NPY_HEADER_SIZE - 1] = '\n';
+    return write_all(array->fd, header, sizeof(header), 0);
+}
+
+/**
+ * Length recorded in a header we wrote, 0 if it is not one of ours
+ */
+static int npy_parse_header(const char* header, const char* descr, uint64_t* length) {
+    char expected[32];
+    snprintf(expected, sizeof(expected), "'descr': '%s'", descr);
+    if (memcmp(header, npy_magic, 8) != 0 ||
+        (uint8_t)header[8] + ((uint8_t)header[9] << 8) != NPY_HEADER_SIZE - 10 ||
+        header[NPY_HEADER_SIZE - 1] != '\n') {
+        return 0;
+    }
+    char dict[NPY_HEADER_SIZE];
+    memcpy(dict, header + 10, NPY_HEADER_SIZE - 10);
+    dict[NPY_HEADER_SIZE - 11] = '\0';
+    const char* shape = strstr(dict, "'shape': (");
+    if (!strstr(dict, expected) || !strstr(dict, "'fortran_order': False") || !shape) return 0;
+    char* end;
+    *length = strtoull(shape + strlen("'shape': ("), &end, 10);
+    return *end == ',';
+}
+
+static void npy_close(npy_array_t* array) {
+    if (array->fd >= 0) close(array->fd);
+    array->fd = -1;
+}
+
+static int npy_open(npy_array_t* array, const char* path, const char* descr, size_t item_size, int truncate) {
+    memset(array, 0, sizeof(npy_array_t));
+    array->descr = descr;
+    array->item_size = item_size;
+    array->fd = open(path, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (array->fd < 0) {
+        perror("Failed to open dataset file");
+        return 0;
+    }
+    struct stat st;
+    if (fstat(array->fd, &st) != 0) {
+        perror("Failed to stat dataset file");
+        npy_close(array);
+        return 0;
+    }
+    if (st.st_size == 0) return npy_commit(array);
+
+    char header[NPY_HEADER_SIZE];
+    uint64_t length;
+    if ((size_t)st.st_size < NPY_HEADER_SIZE || !read_all(array->fd, header, sizeof(header), 0) ||
+        !npy_parse_header(header, descr, &length) ||
+        length > ((uint64_t)st.st_size - NPY_HEADER_SIZE) / item_size) {
+        fprintf(stderr, "%s is not a dataset file of this collector\n", path);
+        npy_close(array);
+        return 0;
+    }
+    array->length = length;
+    return 1;
+}
+
+/**
+ * Cut the array back to length items, data and header
+ */
+static int npy_truncate(npy_array_t* array, uint64_t length) {
+    array->length = length;
+    if (ftruncate(array->fd, (off_t)(NPY_HEADER_SIZE + length * array->item_size)) != 0) {
+        perror("Failed to truncate dataset file");
+        return 0;
+    }
+    return npy_commit(array);
+}
+
+static int npy_write(npy_array_t* array, const void* items, uint64_t count) {
+    return write_all(array->fd, items, count * array->item_size, NPY_HEADER_SIZE + array->length * array->item_size);
+}
+
+int npy_dataset_open(npy_dataset_t* ds, const char* prefix, int truncate) {
+    if (!ds || !prefix) return 0;
+    memset(ds, 0, sizeof(npy_dataset_t));
+    ds->values.fd = ds->offsets.fd = ds->labels.fd = -1;
+    char path[512];
+    snprintf(path, sizeof(path), "%s.values.npy", prefix);
+    int ok = npy_open(&ds->values, path, "<u8", sizeof(uint64_t), truncate);
+    snprintf(path, sizeof(path), "%s.offsets.npy", prefix);
+    ok = ok && npy_open(&ds->offsets, path, "<u8", sizeof(uint64_t), truncate);
+    snprintf(path, sizeof(path), "%s.labels.npy", prefix);
+    ok = ok && npy_open(&ds->labels, path, "<i4", sizeof(int32_t), truncate);
+    if (!ok) {
+        npy_dataset_close(ds);
+        return 0;
+    }
+
+    if (ds->offsets.length == 0) {
+        // offsets always starts with the 0 of the first round
+        uint64_t zero = 0;
+        ok = npy_write(&ds->offsets, &zero, 1) && npy_truncate(&ds->offsets, 1);
+    }
+    // Keep the rounds that made it into all three files
+    uint64_t rounds = ds->offsets.length - 1;
+    if (ds->labels.length < rounds) rounds = ds->labels.length;
+    ds->num_rounds = rounds;
+    if (!ok || !npy_dataset_truncate(ds, rounds)) {
+        npy_dataset_close(ds);
+        return 0;
+    }
+    return 1;
+}
+
+int npy_dataset_truncate(npy_dataset_t* ds, uint64_t num_rounds) {
+    if (!ds) return 0;
+    if (num_rounds > ds->num_rounds) num_rounds = ds->num_rounds;
+    uint64_t end = 0;
+    if (!read_all(ds->offsets.fd, &end, sizeof(end), NPY_HEADER_SIZE + num_rounds * sizeof(uint64_t))) {
+        perror("Failed to read dataset offsets");
+        return 0;
+    }
+    if (end > ds->values.length) {
+        fprintf(stderr, "Dataset is inconsistent, truncate it or start a fresh campaign\n");
+        return 0;
+    }
+    if (!npy_truncate(&ds->values, end) || !npy_truncate(&ds->labels, num_rounds) ||
+        !npy_truncate(&ds->offsets, num_rounds + 1)) {
+        return 0;
+    }
+    ds->num_rounds = num_rounds;
+    return 1;
+}
+
+int npy_dataset_append(npy_dataset_t* ds, int32_t label, const uint64_t* values, uint64_t count) {
+    if (!ds || (!values && count)) return 0;
+    uint64_t end = ds->values.length + count;
+    if (!npy_write(&ds->values, values, count) || !npy_write(&ds->labels, &label, 1) ||
+        !npy_write(&ds->offsets, &end, 1)) {
+        return 0;
+    }
+    ds->values.length = end;
+    ds->labels.length++;
+    ds->offsets.length++;
+    if (!npy_commit(&ds->values) || !npy_commit(&ds->labels) || !npy_commit(&ds->offsets)) return 0;
+    ds->num_rounds++;
+    return 1;
+}
+
+int npy_dataset_close(npy_dataset_t* ds) {
+    if (!ds) return 0;
+    npy_close(&ds->values);
+    npy_close(&ds->offsets);
+    npy_close(&ds->labels);
+    return 1;
+}
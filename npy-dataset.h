@@ -0,0 +1,51 @@
+#ifndef NPY_DATASET_H
+#define NPY_DATASET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NPY_HEADER_SIZE 128     // Fixed, so the shape can be rewritten in place as rows are appended
+
+/**
+ * One-dimensional .npy file (format 1.0) that grows at the end
+ */
+typedef struct {
+    int fd;
+    const char* descr;          // NumPy dtype, e.g. "<u8"
+    size_t item_size;
+    uint64_t length;            // Items covered by the header
+} npy_array_t;
+
+/**
+ * Ragged dataset of rounds, loadable with np.load(mmap_mode='r'):
+ *   <prefix>.values.npy   uint64 timings of every round, back to back
+ *   <prefix>.offsets.npy  uint64, round i is values[offsets[i]:offsets[i + 1]]
+ *   <prefix>.labels.npy   int32 label of every round
+ * The offsets header is rewritten last, so a round is either complete or absent.
+ */
+typedef struct {
+    npy_array_t values;
+    npy_array_t offsets;
+    npy_array_t labels;
+    uint64_t num_rounds;
+} npy_dataset_t;
+
+/**
+ * Open the dataset files of prefix for appending, or start them empty when truncate is set.
+ * Anything past the last complete round (an interrupted append) is dropped.
+ */
+int npy_dataset_open(npy_dataset_t* ds, const char* prefix, int truncate);
+
+/**
+ * Keep only the first num_rounds rounds (e.g. the ones a manifest records as done)
+ */
+int npy_dataset_truncate(npy_dataset_t* ds, uint64_t num_rounds);
+
+/**
+ * Append one round of count values
+ */
+int npy_dataset_append(npy_dataset_t* ds, int32_t label, const uint64_t* values, uint64_t count);
+
+int npy_dataset_close(npy_dataset_t* ds);
+
+#endif //NPY_DATASET_H
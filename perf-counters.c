@@ -0,0 +1,99 @@
+#include "perf-counters.h"
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define LLC_CACHE_EVENT(result) (PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | ((result) << 16))
+#define DTLB_MISS_EVENT (PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+// Instructions first: it is the event most likely to exist, so it leads the group
+static const perf_counter_id_t open_order[PERF_NUM_COUNTERS] = {
+    PERF_INSTRUCTIONS, PERF_LLC_MISSES, PERF_LLC_LOADS, PERF_DTLB_MISSES
+};
+
+static void event_attr(perf_counter_id_t id, struct perf_event_attr* attr) {
+    memset(attr, 0, sizeof(struct perf_event_attr));
+    attr->size = sizeof(struct perf_event_attr);
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_GROUP;
+    switch (id) {
+        case PERF_INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = LLC_CACHE_EVENT(PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case PERF_LLC_LOADS:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = LLC_CACHE_EVENT(PERF_COUNT_HW_CACHE_RESULT_ACCESS);
+            break;
+        default:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = DTLB_MISS_EVENT;
+            break;
+    }
+}
+
+static int perf_event_open(struct perf_event_attr* attr, int group_fd) {
+    return (int)syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+int perf_counters_open(perf_counters_t* pc) {
+    if (!pc) return 0;
+    memset(pc, 0, sizeof(perf_counters_t));
+    pc->leader_fd = -1;
+    for (int i = 0; i < PERF_NUM_COUNTERS; ++i) {
+        pc->fds[i] = -1;
+        pc->group_pos[i] = -1;
+    }
+
+    for (int i = 0; i < PERF_NUM_COUNTERS; ++i) {
+        perf_counter_id_t id = open_order[i];
+        struct perf_event_attr attr;
+        event_attr(id, &attr);
+        attr.disabled = pc->leader_fd == -1; // the leader starts the whole group
+
+        int fd = perf_event_open(&attr, pc->leader_fd);
+        if (fd == -1) continue; // this event isn't available here, keep the others
+        if (pc->leader_fd == -1) pc->leader_fd = fd;
+        pc->fds[id] = fd;
+        pc->group_pos[id] = pc->num_open++;
+    }
+
+    if (pc->leader_fd == -1) {
+        perror("perf_event_open");
+        return 0;
+    }
+    ioctl(pc->leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(pc->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return 1;
+}
+
+int perf_counters_read(const perf_counters_t* pc, perf_sample_t* out) {
+    if (!pc || !out || pc->leader_fd == -1) return 0;
+    uint64_t buf[1 + PERF_NUM_COUNTERS]; // nr, then one value per open counter
+    ssize_t expected = (ssize_t)((1 + pc->num_open) * sizeof(uint64_t));
+    if (read(pc->leader_fd, buf, sizeof(buf)) < expected) return 0;
+
+    for (int i = 0; i < PERF_NUM_COUNTERS; ++i) {
+        out->values[i] = pc->group_pos[i] >= 0 ? buf[1 + pc->group_pos[i]] : 0;
+    }
+    return 1;
+}
+
+void perf_counters_close(perf_counters_t* pc) {
+    if (!pc) return;
+    for (int i = 0; i < PERF_NUM_COUNTERS; ++i) {
+        if (pc->fds[i] != -1) close(pc->fds[i]);
+        pc->fds[i] = -1;
+        pc->group_pos[i] = -1;
+    }
+    pc->leader_fd = -1;
+    pc->num_open = 0;
+}
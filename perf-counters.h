@@ -0,0 +1,46 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+#include <stdint.h>
+
+/**
+ * Hardware counters recorded next to every timing sample
+ */
+typedef enum {
+    PERF_LLC_MISSES,            // LLC-load-misses
+    PERF_LLC_LOADS,             // LLC-loads
+    PERF_DTLB_MISSES,           // dTLB-load-misses
+    PERF_INSTRUCTIONS,          // instructions retired
+    PERF_NUM_COUNTERS
+} perf_counter_id_t;
+
+/**
+ * Counter values (or deltas) indexed by perf_counter_id_t; 0 for counters that couldn't be opened
+ */
+typedef struct {
+    uint64_t values[PERF_NUM_COUNTERS];
+} perf_sample_t;
+
+/**
+ * A perf_event group on the calling thread, read with a single grouped read()
+ */
+typedef struct {
+    int fds[PERF_NUM_COUNTERS];         // fds[i] for counter i, -1 if unavailable
+    int group_pos[PERF_NUM_COUNTERS];   // Position of counter i in the group read, -1 if unavailable
+    int leader_fd;
+    int num_open;
+} perf_counters_t;
+
+/**
+ * Open the counter group for the calling thread (any CPU).
+ * Returns 0 when perf events aren't permitted/supported at all; the probe then runs on timing only.
+ */
+int perf_counters_open(perf_counters_t* pc);
+
+/**
+ * Read all counters of the group at once
+ */
+int perf_counters_read(const perf_counters_t* pc, perf_sample_t* out);
+
+void perf_counters_close(perf_counters_t* pc);
+
+#endif //PERF_COUNTERS_H
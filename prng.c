@@ -0,0 +1,27 @@
+#include "prng.h"
+#include "utils.h"
+#include <sys/random.h>
+
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void prng_seed(prng_t* rng, uint64_t seed) {
+    if (!rng) return;
+    uint64_t state = seed;
+    for (int i = 0; i < 4; ++i) {
+        rng->s[i] = splitmix64(&state);
+    }
+}
+
+uint64_t prng_random_seed(void) {
+    uint64_t seed;
+    if (getrandom(&seed, sizeof(seed), 0) == sizeof(seed)) {
+        return seed;
+    }
+    uint64_t state = rdtscp64();
+    return splitmix64(&state);
+}
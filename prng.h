@@ -0,0 +1,55 @@
+#ifndef PRNG_H
+#define PRNG_H
+#include <stdint.h>
+
+/**
+ * xoshiro256** state, one per memorygrammer so shuffles are independent and reproducible
+ */
+typedef struct {
+    uint64_t s[4];
+} prng_t;
+
+/**
+ * Seed the generator; the state is expanded from the seed with splitmix64
+ */
+void prng_seed(prng_t* rng, uint64_t seed);
+
+/**
+ * A fresh seed from the kernel (getrandom), falls back to the TSC
+ */
+uint64_t prng_random_seed(void);
+
+static inline uint64_t prng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t prng_next(prng_t* rng) {
+    uint64_t* s = rng->s;
+    const uint64_t result = prng_rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prng_rotl(s[3], 45);
+    return result;
+}
+
+/**
+ * Unbiased value in [0, bound) using Lemire's multiply-shift with rejection
+ */
+static inline uint64_t prng_bounded(prng_t* rng, uint64_t bound) {
+    __uint128_t m = (__uint128_t)prng_next(rng) * bound;
+    uint64_t low = (uint64_t)m;
+    if (low < bound) {
+        const uint64_t threshold = -bound % bound;
+        while (low < threshold) {
+            m = (__uint128_t)prng_next(rng) * bound;
+            low = (uint64_t)m;
+        }
+    }
+    return (uint64_t)(m >> 64);
+}
+
+#endif //PRNG_H
@@ -0,0 +1,102 @@
+#include "probe-arena.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define KB_NORMALIZER 1024 //2^10
+#define THP_SIZE (2 * 1024 * 1024) // transparent hugepage size on x86-64
+
+static size_t round_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+/**
+ * Try to back the arena with reserved hugepages.
+ * Only attempted if the pool reported in /proc/meminfo can hold the whole region.
+ */
+static int map_hugetlb(probe_arena_t* arena, const cpu_config_t* config, size_t bytes) {
+    if (config->hugepages_free <= 0 || config->hugepage_size_kb == 0) return 0;
+
+    size_t page_size = config->hugepage_size_kb * KB_NORMALIZER;
+    size_t size = round_up(bytes, page_size);
+    if (size / page_size > (size_t)config->hugepages_free) return 0;
+
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (base == MAP_FAILED) return 0;
+
+    arena->base = base;
+    arena->size = size;
+    arena->is_hugetlb = 1;
+    return 1;
+}
+
+/**
+ * Fallback: regular pages, aligned to the THP size and advised as MADV_HUGEPAGE.
+ * The region is faulted in only after the advice, otherwise MAP_POPULATE would
+ * lock it into 4K pages before khugepaged gets a chance.
+ */
+static int map_regular(probe_arena_t* arena, size_t bytes) {
+    size_t size = round_up(bytes, THP_SIZE);
+    size_t reserve = size + THP_SIZE; // slack so the start can be aligned
+
+    uint8_t* raw = mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        perror("Failed to map probe arena");
+        return 0;
+    }
+
+    // Trim the slack so the region starts and ends on a THP boundary
+    uint8_t* base = (uint8_t*)round_up((uintptr_t)raw, THP_SIZE);
+    size_t head = base - raw;
+    size_t tail = reserve - head - size;
+    if (head) munmap(raw, head);
+    if (tail) munmap(base + size, tail);
+
+#ifdef MADV_HUGEPAGE
+    madvise(base, size, MADV_HUGEPAGE);
+#endif
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(base, size, MADV_POPULATE_WRITE) != 0)
+#endif
+    {
+        memset(base, 0, size); // pre-fault every page
+    }
+
+    arena->base = base;
+    arena->size = size;
+    arena->is_hugetlb = 0;
+    return 1;
+}
+
+int arena_init(probe_arena_t* arena, const cpu_config_t* config, size_t bytes) {
+    if (!arena || !config || bytes == 0) return 0;
+    memset(arena, 0, sizeof(probe_arena_t));
+
+    if (!map_hugetlb(arena, config, bytes) && !map_regular(arena, bytes)) return 0;
+#ifdef MADV_DONTFORK
+    // Victims are forked while the probe runs; sharing the arena copy-on-write
+    // would turn every relink into a page fault
+    madvise(arena->base, arena->size, MADV_DONTFORK);
+#endif
+    return 1;
+}
+
+void* arena_alloc(probe_arena_t* arena, size_t bytes, size_t align) {
+    if (!arena || !arena->base) return NULL;
+    if (align == 0) align = 1;
+
+    size_t offset = round_up(arena->used, align);
+    if (offset + bytes > arena->size) return NULL;
+
+    arena->used = offset + bytes;
+    return (uint8_t*)arena->base + offset;
+}
+
+void arena_free(probe_arena_t* arena) {
+    if (!arena || !arena->base) return;
+    munmap(arena->base, arena->size);
+    memset(arena, 0, sizeof(probe_arena_t));
+}
@@ -0,0 +1,38 @@
+#ifndef PROBE_ARENA_H
+#define PROBE_ARENA_H
+
+#include <stddef.h>
+#include "cpu-config.h"
+
+/**
+ * A single anonymous mapping that backs every probe node.
+ * Nodes are carved out of it back to back, so the probe buffer is dense
+ * and covered by as few TLB entries as the page size allows.
+ */
+typedef struct {
+    void* base;                 // Start of the mapping
+    size_t size;                // Total mapped bytes
+    size_t used;                // Bytes handed out so far
+    int is_hugetlb;             // 1 if backed by MAP_HUGETLB pages, 0 if 4K pages (+THP hint)
+} probe_arena_t;
+
+/**
+ * Map a region of at least `bytes` bytes.
+ * Uses MAP_HUGETLB when enough free hugepages are reported in the config,
+ * otherwise falls back to regular pages advised with MADV_HUGEPAGE.
+ * The whole region is pre-faulted so no page fault happens while probing.
+ */
+int arena_init(probe_arena_t* arena, const cpu_config_t* config, size_t bytes);
+
+/**
+ * Hand out `bytes` bytes aligned to `align` (power of two).
+ * Returns NULL when the arena is exhausted.
+ */
+void* arena_alloc(probe_arena_t* arena, size_t bytes, size_t align);
+
+/**
+ * Release the whole mapping with a single munmap
+ */
+void arena_free(probe_arena_t* arena);
+
+#endif //PROBE_ARENA_H
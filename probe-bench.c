@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+#include "cpu-config.h"
+#include "memorygrammer.h"
+#include "probe-arena.h"
+#include "prng.h"
+#include "utils.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * Microbenchmarks of the probe engine primitives, written as one JSON object:
+ *   probe_bench [--duration-ms N] [--reps N] [--core N] > bench.json
+ * Everything else the library prints goes to stderr.
+ */
+
+#define NS_PER_MS 1000000ULL
+#define TIMER_SAMPLES 1000000   // rdtscp64() pairs for overhead and jitter
+#define MIN_CHASE_HOPS (1 << 24) // hops per chase measurement at least
+
+typedef enum {
+    ALLOC_ARENA,                // probe_arena_t: hugetlb, else THP-aligned
+    ALLOC_MALLOC,               // aligned_alloc(), whatever the libc hands out
+    ALLOC_MMAP_4K,              // anonymous mmap with MADV_NOHUGEPAGE
+    NUM_ALLOCATORS
+} bench_alloc_t;
+
+static const char* const allocator_names[NUM_ALLOCATORS] = {"arena", "malloc", "mmap-4k"};
+
+typedef struct {
+    void* base;
+    size_t size;
+    probe_arena_t arena;
+    bench_alloc_t kind;
+} bench_region_t;
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double cycles_to_ns(const cpu_config_t* config, double cycles) {
+    return cycles * 1e9 / (double)config->timer.tsc_hz;
+}
+
+static void json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') fprintf(out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(out, "\\u%04x", *s);
+        else fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * min/median/p99/max/mean/stddev of values (sorted in place)
+ */
+static void json_stats(FILE* out, uint64_t* values, size_t n) {
+    qsort(values, n, sizeof(uint64_t), compare_u64);
+    double mean = 0, var = 0;
+    for (size_t i = 0; i < n; ++i) mean += (double)values[i];
+    mean /= (double)n;
+    for (size_t i = 0; i < n; ++i) var += ((double)values[i] - mean) * ((double)values[i] - mean);
+    double stddev = n > 1 ? sqrt(var / (double)(n - 1)) : 0;
+    fprintf(out, "\"samples\": %zu, \"min\": %" PRIu64 ", \"median\": %" PRIu64 ", \"p99\": %" PRIu64
+                 ", \"max\": %" PRIu64 ", \"mean\": %.2f, \"stddev\": %.2f, \"cv\": %.5f",
+            n, values[0], values[n / 2], values[n * 99 / 100], values[n - 1], mean, stddev,
+            mean > 0 ? stddev / mean : 0);
+}
+
+static int region_alloc(bench_region_t* region, bench_alloc_t kind, const cpu_config_t* config, size_t bytes) {
+    memset(region, 0, sizeof(bench_region_t));
+    region->kind = kind;
+    region->size = bytes;
+    switch (kind) {
+        case ALLOC_ARENA:
+            if (!arena_init(&region->arena, config, bytes)) return 0;
+            region->base = region->arena.base;
+            return 1;
+        case ALLOC_MALLOC:
+            region->base = aligned_alloc(config->cache_line_size, bytes);
+            if (!region->base) return 0;
+            memset(region->base, 0, bytes);
+            return 1;
+        default:
+            region->base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (region->base == MAP_FAILED) {
+                region->base = NULL;
+                return 0;
+            }
+#ifdef MADV_NOHUGEPAGE
+            madvise(region->base, bytes, MADV_NOHUGEPAGE);
+#endif
+            memset(region->base, 0, bytes);
+            return 1;
+    }
+}
+
+static void region_free(bench_region_t* region) {
+    if (!region->base) return;
+    if (region->kind == ALLOC_ARENA) arena_free(&region->arena);
+    else if (region->kind == ALLOC_MALLOC) free(region->base);
+    else munmap(region->base, region->size);
+    region->base = NULL;
+}
+
+/**
+ * Link one node per cache line of region, in address order or shuffled.
+ * Returns the head, NULL on failure
+ */
+static probe_node_t* link_region(const bench_region_t* region, size_t line_size, int shuffled, prng_t* rng) {
+    size_t n = region->size / line_size;
+    size_t* order = malloc(n * sizeof(size_t));
+    if (!order) return NULL;
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    if (shuffled) {
+        for (size_t i = n - 1; i > 0; --i) {
+            size_t j = prng_bounded(rng, i + 1);
+            size_t tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+    }
+    uint8_t* base = region->base;
+    for (size_t i = 0; i < n; ++i) {
+        probe_node_t* node = (probe_node_t*)(base + order[i] * line_size);
+        node->next = (probe_node_t*)(base + order[(i + 1) % n] * line_size);
+    }
+    probe_node_t* head = (probe_node_t*)(base + order[0] * line_size);
+    free(order);
+    return head;
+}
+
+/**
+ * Best-of-reps cycles per hop of a chain of n nodes
+ */
+static double chase_cycles_per_hop(probe_node_t* head, size_t n, unsigned reps) {
+    size_t hops = n < MIN_CHASE_HOPS ? (MIN_CHASE_HOPS / n) * n : n;
+    volatile probe_node_t* curr = head;
+    for (size_t j = 0; j < n; ++j) curr = curr->next; // warm up
+    double best = INFINITY;
+    for (unsigned r = 0; r < reps; ++r) {
+        uint64_t start = rdtscp64();
+        for (size_t j = 0; j < hops; ++j) curr = curr->next;
+        uint64_t end = rdtscp64();
+        double per_hop = (double)(end - start) / (double)hops;
+        if (per_hop < best) best = per_hop;
+    }
+    return best;
+}
+
+static void bench_timer(FILE* out, const cpu_config_t* config) {
+    uint64_t* deltas = malloc(TIMER_SAMPLES * sizeof(uint64_t));
+    if (!deltas) return;
+    for (size_t i = 0; i < TIMER_SAMPLES; ++i) {
+        uint64_t a = rdtscp64();
+        uint64_t b = rdtscp64();
+        deltas[i] = b - a;
+    }
+    fprintf(out, "  \"rdtscp\": {\"calibrated_overhead\": %" PRIu64 ", ", config->timer.overhead_cycles);
+    json_stats(out, deltas, TIMER_SAMPLES);
+    fprintf(out, "},\n");
+    free(deltas);
+}
+
+static void bench_chase(FILE* out, const cpu_config_t* config, unsigned reps) {
+    const size_t sizes[] = {32 << 10, 1 << 20, config->llc_size_bytes / 2, config->llc_size_bytes * 2};
+    const char* const size_names[] = {"l1", "l2", "llc", "dram"};
+    prng_t rng;
+    prng_seed(&rng, 1);
+    int first = 1;
+    fprintf(out, "  \"chase\": [");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        for (int kind = 0; kind < NUM_ALLOCATORS; ++kind) {
+            bench_region_t region;
+            if (!region_alloc(&region, kind, config, sizes[s])) {
+                fprintf(stderr, "%s: could not allocate %zu bytes\n", allocator_names[kind], sizes[s]);
+                continue;
+            }
+            for (int shuffled = 0; shuffled <= 1; ++shuffled) {
+                fprintf(stderr, "chase %s %s %s\n", size_names[s], allocator_names[kind],
+                        shuffled ? "random" : "sequential");
+                probe_node_t* head = link_region(&region, config->cache_line_size, shuffled, &rng);
+                if (!head) continue;
+                double cycles = chase_cycles_per_hop(head, sizes[s] / config->cache_line_size, reps);
+                fprintf(out, "%s\n    {\"level\": \"%s\", \"bytes\": %zu, \"allocator\": \"%s\", \"hugetlb\": %s, "
+                             "\"layout\": \"%s\", \"cycles_per_hop\": %.3f, \"ns_per_hop\": %.3f}",
+                        first ? "" : ",", size_names[s], sizes[s], allocator_names[kind],
+                        kind == ALLOC_ARENA && region.arena.is_hugetlb ? "true" : "false",
+                        shuffled ? "random" : "sequential", cycles, cycles_to_ns(config, cycles));
+                first = 0;
+            }
+            region_free(&region);
+        }
+    }
+    fprintf(out, "\n  ],\n");
+}
+
+static void bench_shuffle(FILE* out, memorygrammer_t* mg, unsigned reps) {
+    fprintf(stderr, "shuffle\n");
+    uint64_t best = UINT64_MAX;
+    for (unsigned r = 0; r < reps; ++r) {
+        uint64_t start = rdtscp64();
+        shuffle_linked_list(mg, mg->num_nodes);
+        uint64_t cycles = rdtscp64() - start;
+        if (cycles < best) best = cycles;
+    }
+    double per_node = (double)best / (double)mg->num_nodes;
+    fprintf(out, "  \"shuffle\": {\"nodes\": %zu, \"cycles_per_node\": %.3f, \"ns_per_node\": %.3f},\n",
+            mg->num_nodes, per_node, cycles_to_ns(mg->config, per_node));
+}
+
+static void bench_sweeps(FILE* out, memorygrammer_t* mg, uint64_t duration_cycles) {
+    fprintf(stderr, "sweeps\n");
+    // run_probe() only sizes the ring from the interval: size it from one timed sweep instead,
+    // with headroom for faster sweeps, so the stats cover the whole run and not just its tail
+    volatile probe_node_t* curr = mg->head;
+    for (size_t j = 0; j < mg->num_nodes; ++j) curr = curr->next;
+    uint64_t start = rdtscp64();
+    for (size_t j = 0; j < mg->num_nodes; ++j) curr = curr->next;
+    uint64_t sweep = rdtscp64() - start;
+    if (sweep == 0) sweep = 1;
+    if (!reserve_timings(mg, duration_cycles / sweep * 2 + 1)) return;
+    run_probe(mg, 0, duration_cycles);
+    if (mg->total_samples > mg->num_samples) {
+        fprintf(stderr, "sweep ring wrapped, stats cover the last %zu of %zu sweeps\n", mg->num_samples,
+                mg->total_samples);
+    }
+    size_t n = mg->num_samples;
+    uint64_t* values = malloc((n ? n : 1) * sizeof(uint64_t));
+    if (!values || n == 0) {
+        free(values);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) values[i] = get_timing(mg, i);
+    fprintf(out, "  \"sweep\": {\"nodes\": %zu, ", mg->num_nodes);
+    json_stats(out, values, n);
+    fprintf(out, "},\n");
+    free(values);
+}
+
+static void bench_sample_rate(FILE* out, memorygrammer_t* mg, uint64_t duration_ms) {
+    const uint64_t intervals_us[] = {100, 500, 1000, 2000, 5000, 10000};
+    const size_t count = sizeof(intervals_us) / sizeof(intervals_us[0]);
+    const tsc_timer_t* timer = &mg->config->timer;
+    uint64_t duration_cycles = tsc_ns_to_cycles(timer, duration_ms * NS_PER_MS);
+    fprintf(out, "  \"sample_rate\": [");
+    for (size_t i = 0; i < count; ++i) {
+        fprintf(stderr, "sample rate %" PRIu64 " us\n", intervals_us[i]);
+        uint64_t interval = tsc_ns_to_cycles(timer, intervals_us[i] * 1000);
+        run_probe(mg, interval, duration_cycles);
+        double seconds = (double)duration_ms / 1000.0;
+        fprintf(out, "%s\n    {\"interval_us\": %" PRIu64 ", \"interval_cycles\": %" PRIu64
+                     ", \"target_hz\": %.1f, \"achieved_hz\": %.1f, \"samples\": %zu, \"overruns\": %zu}",
+                i ? "," : "", intervals_us[i], interval, 1e6 / (double)intervals_us[i],
+                (double)mg->total_samples / seconds, mg->total_samples, mg->overruns);
+    }
+    fprintf(out, "\n  ]\n");
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t duration_ms = 2000;
+    unsigned reps = 5;
+    int core = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--duration-ms") == 0 && i + 1 < argc) duration_ms = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) reps = (unsigned)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--core") == 0 && i + 1 < argc) core = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "Usage: %s [--duration-ms N] [--reps N] [--core N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (reps == 0) reps = 1;
+
+    // Keep stdout for the JSON only, library chatter goes to stderr
+    fflush(stdout);
+    int json_fd = dup(STDOUT_FILENO);
+    FILE* out = json_fd >= 0 ? fdopen(json_fd, "w") : NULL;
+    if (!out || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        perror("Failed to set up output");
+        return EXIT_FAILURE;
+    }
+
+    pin_to_core(core);
+    cpu_config_t config;
+    if (detect_cpu_config(&config) != 1) {
+        fprintf(stderr, "Failed to detect CPU configuration\n");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n  \"cpu\": {\"model\": ");
+    json_string(out, config.model_name);
+    fprintf(out, ", \"llc_bytes\": %zu, \"line_size\": %zu, \"tsc_hz\": %" PRIu64 ", \"invariant_tsc\": %s},\n",
+            config.llc_size_bytes, config.cache_line_size, config.timer.tsc_hz,
+            config.timer.invariant ? "true" : "false");
+    bench_timer(out, &config);
+    bench_chase(out, &config, reps);
+
+    memorygrammer_t mg;
+    if (!init_memorygrammer(&mg, &config)) {
+        fprintf(stderr, "Failed to initialize memorygrammer.\n");
+        fprintf(out, "  \"error\": \"memorygrammer\"\n}\n");
+        fclose(out);
+        return EXIT_FAILURE;
+    }
+    bench_shuffle(out, &mg, reps);
+    bench_sweeps(out, &mg, tsc_ns_to_cycles(&config.timer, duration_ms * NS_PER_MS));
+    bench_sample_rate(out, &mg, duration_ms);
+    fprintf(out, "}\n");
+    free_memorygrammer(&mg);
+    fclose(out);
+    return EXIT_SUCCESS;
+}
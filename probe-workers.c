@@ -0,0 +1,182 @@
+#include "probe-workers.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define START_LEAD_CYCLES 10000000ULL // slot 0 is placed this far ahead of the barrier release
+
+static void* worker_main(void* arg) {
+    probe_worker_t* worker = arg;
+    worker_pool_t* pool = worker->pool;
+    // Wait until every worker thread exists, the barriers count all of them
+    pthread_mutex_lock(&pool->launch_lock);
+    while (pool->launch == 0) pthread_cond_wait(&pool->launch_cond, &pool->launch_lock);
+    int launch = pool->launch;
+    pthread_mutex_unlock(&pool->launch_lock);
+    if (launch < 0) return NULL;
+
+    pin_to_core(worker->core);
+    worker->ok = init_memorygrammer(&worker->mg, pool->config); // first touch on the worker's core
+    pthread_barrier_wait(&pool->done_barrier); // init done
+
+    for (;;) {
+        pthread_barrier_wait(&pool->start_barrier);
+        if (pool->stop) break;
+        if (worker->ok) {
+            run_probe_scheduled(&worker->mg, pool->interval_cycles, pool->probe_cycles,
+                                pool->policy, pool->start_tsc);
+        }
+        pthread_barrier_wait(&pool->done_barrier);
+    }
+    return NULL;
+}
+
+int init_worker_pool(worker_pool_t* pool, cpu_config_t* config, const int* cores, size_t num_workers) {
+    if (!pool || !config || !cores || num_workers == 0) return 0;
+    memset(pool, 0, sizeof(worker_pool_t));
+    pool->config = config;
+
+    pool->workers = calloc(num_workers, sizeof(probe_worker_t));
+    if (!pool->workers) {
+        perror("Failed to allocate workers");
+        return 0;
+    }
+    // Workers plus the coordinating thread
+    pthread_barrier_init(&pool->start_barrier, NULL, num_workers + 1);
+    pthread_barrier_init(&pool->done_barrier, NULL, num_workers + 1);
+    pthread_mutex_init(&pool->launch_lock, NULL);
+    pthread_cond_init(&pool->launch_cond, NULL);
+
+    size_t started = 0;
+    for (; started < num_workers; ++started) {
+        probe_worker_t* worker = &pool->workers[started];
+        worker->pool = pool;
+        worker->core = cores[started];
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            perror("Failed to start probe worker");
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&pool->launch_lock);
+    pool->launch = started == num_workers ? 1 : -1;
+    pthread_cond_broadcast(&pool->launch_cond);
+    pthread_mutex_unlock(&pool->launch_lock);
+    if (started < num_workers) {
+        // Can't satisfy the barriers with fewer threads: the started ones return without probing
+        for (size_t w = 0; w < started; ++w) pthread_join(pool->workers[w].thread, NULL);
+        pthread_barrier_destroy(&pool->start_barrier);
+        pthread_barrier_destroy(&pool->done_barrier);
+        pthread_mutex_destroy(&pool->launch_lock);
+        pthread_cond_destroy(&pool->launch_cond);
+        free(pool->workers);
+        memset(pool, 0, sizeof(worker_pool_t));
+        return 0;
+    }
+    pool->num_workers = num_workers;
+    pthread_barrier_wait(&pool->done_barrier);
+
+    for (size_t w = 0; w < num_workers; ++w) {
+        if (!pool->workers[w].ok) {
+            fprintf(stderr, "Probe worker on core %d failed to initialize\n", pool->workers[w].core);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Lays every worker's samples out on the shared slot grid
+ */
+static int merge_worker_traces(worker_pool_t* pool) {
+    size_t num_slots = pool->probe_cycles / pool->interval_cycles;
+    if (num_slots != pool->num_slots || !pool->merged) {
+        free(pool->merged);
+        pool->merged = calloc(num_slots * pool->num_workers, sizeof(uint64_t));
+        if (!pool->merged) {
+            perror("Failed to allocate merged trace");
+            pool->num_slots = 0;
+            return 0;
+        }
+        pool->num_slots = num_slots;
+    } else {
+        memset(pool->merged, 0, num_slots * pool->num_workers * sizeof(uint64_t));
+    }
+
+    for (size_t w = 0; w < pool->num_workers; ++w) {
+        const memorygrammer_t* mg = &pool->workers[w].mg;
+        for (size_t i = 0; i < mg->num_samples; ++i) {
+            size_t idx = sample_index(mg, i);
+            uint64_t slot = mg->slots[idx];
+            if (slot < num_slots) {
+                pool->merged[slot * pool->num_workers + w] = mg->timings[idx];
+            }
+        }
+    }
+    return 1;
+}
+
+int run_worker_round(worker_pool_t* pool, uint64_t interval_cycles, uint64_t probe_cycles, sched_policy_t policy) {
+    if (!pool || !pool->workers || interval_cycles == 0) return 0;
+    pool->interval_cycles = interval_cycles;
+    pool->probe_cycles = probe_cycles;
+    pool->policy = policy;
+    pool->start_tsc = rdtscp64() + START_LEAD_CYCLES; // invariant TSC is shared by all cores
+
+    pthread_barrier_wait(&pool->start_barrier);
+    pthread_barrier_wait(&pool->done_barrier);
+    return merge_worker_traces(pool);
+}
+
+int write_merged_trace_to_csv(const worker_pool_t* pool, const char* path) {
+    if (!pool || !pool->merged || !path) return 0;
+
+    FILE* f = fopen(path, "a");
+    if (!f) {
+        perror("Failed to open CSV file");
+        return 0;
+    }
+
+    for (size_t slot = 0; slot < pool->num_slots; ++slot) {
+        const uint64_t* row = pool->merged + slot * pool->num_workers;
+        int sampled = 0;
+        for (size_t w = 0; w < pool->num_workers; ++w) {
+            if (row[w]) sampled = 1;
+        }
+        if (!sampled) continue;
+
+        fprintf(f, "%zu, %" PRIu64, slot, (uint64_t)slot * pool->interval_cycles);
+        for (size_t w = 0; w < pool->num_workers; ++w) {
+            if (row[w]) {
+                fprintf(f, ", %" PRIu64, row[w]);
+            } else {
+                fprintf(f, ",");
+            }
+        }
+        fprintf(f, "\n");
+    }
+
+    fclose(f);
+    return 1;
+}
+
+void free_worker_pool(worker_pool_t* pool) {
+    if (!pool || !pool->workers) return;
+
+    pool->stop = 1;
+    pthread_barrier_wait(&pool->start_barrier);
+    for (size_t w = 0; w < pool->num_workers; ++w) {
+        pthread_join(pool->workers[w].thread, NULL);
+        free_memorygrammer(&pool->workers[w].mg);
+    }
+    pthread_barrier_destroy(&pool->start_barrier);
+    pthread_barrier_destroy(&pool->done_barrier);
+    pthread_mutex_destroy(&pool->launch_lock);
+    pthread_cond_destroy(&pool->launch_cond);
+
+    free(pool->workers);
+    free(pool->merged);
+    memset(pool, 0, sizeof(worker_pool_t));
+}
@@ -0,0 +1,67 @@
+#ifndef PROBE_WORKERS_H
+#define PROBE_WORKERS_H
+
+#include <pthread.h>
+#include "memorygrammer.h"
+
+/**
+ * One pinned probe thread with its own memorygrammer and sample buffer
+ */
+typedef struct {
+    struct worker_pool* pool;
+    int core;                   // Core the worker is pinned to
+    memorygrammer_t mg;         // Initialized on the worker's own core
+    pthread_t thread;
+    int ok;                     // 1 if the memorygrammer initialized
+} probe_worker_t;
+
+/**
+ * A set of probe workers that sample on one shared TSC timeline
+ */
+typedef struct worker_pool {
+    cpu_config_t* config;
+    probe_worker_t* workers;
+    size_t num_workers;
+    pthread_barrier_t start_barrier;    // Workers wait here before every round
+    pthread_barrier_t done_barrier;     // And here after it
+    int stop;                   // Set before releasing the start barrier to end the threads
+    pthread_mutex_t launch_lock;
+    pthread_cond_t launch_cond;
+    int launch;                 // 0 until every thread is created, then 1 to start or -1 to give up
+
+    // Parameters of the current round
+    uint64_t interval_cycles;
+    uint64_t probe_cycles;
+    sched_policy_t policy;
+    uint64_t start_tsc;         // Slot 0 of the shared timeline
+
+    // Merged trace of the last round
+    uint64_t* merged;           // [num_slots x num_workers] sweep cycles, 0 = slot not sampled by that worker
+    size_t num_slots;
+} worker_pool_t;
+
+/**
+ * Spawn one worker per core; each pins itself and initializes its memorygrammer.
+ * Returns 0 if any worker failed to come up.
+ */
+int init_worker_pool(worker_pool_t* pool, cpu_config_t* config, const int* cores, size_t num_workers);
+
+/**
+ * Run one scheduled probe on every worker. All workers share slot 0, set a little in
+ * the future so every worker is spinning before it starts. Merges the traces afterwards.
+ */
+int run_worker_round(worker_pool_t* pool, uint64_t interval_cycles, uint64_t probe_cycles, sched_policy_t policy);
+
+/**
+ Write the merged trace to a CSV file
+ Row: slot, cycles since slot 0, then one column per worker (empty if that worker skipped the slot)
+ Only slots sampled by at least one worker are written
+*/
+int write_merged_trace_to_csv(const worker_pool_t* pool, const char* path);
+
+/**
+ * Stop and join the workers, free their memorygrammers and the merged trace
+ */
+void free_worker_pool(worker_pool_t* pool);
+
+#endif //PROBE_WORKERS_H
@@ -0,0 +1,178 @@
+#include "sample-codec.h"
+#include <pthread.h>
+#include <string.h>
+#include <tmmintrin.h>
+
+static uint8_t svb_shuffle[256][16];    // pshufb mask that spreads a group's bytes into 4 uint32
+static uint8_t svb_length[256];         // Data bytes of a group
+static pthread_once_t svb_once = PTHREAD_ONCE_INIT;
+
+static void svb_init_tables(void) {
+    for (int control = 0; control < 256; ++control) {
+        uint8_t src = 0;
+        for (int k = 0; k < 4; ++k) {
+            int len = ((control >> (2 * k)) & 3) + 1;
+            for (int b = 0; b < 4; ++b) {
+                svb_shuffle[control][4 * k + b] = b < len ? src++ : 0x80; // 0x80 zeroes the byte
+            }
+        }
+        svb_length[control] = src;
+    }
+}
+
+static inline uint64_t zigzag(uint64_t value, uint64_t prev) {
+    int64_t d = (int64_t)(value - prev);
+    return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t z) {
+    return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+size_t codec_bound(size_t n) {
+    size_t svb = (n + 3) / 4 + n * 4;
+    size_t leb = n * 10;
+    return svb > leb ? svb : leb;
+}
+
+static size_t svb_encode(const uint64_t* in, size_t n, uint64_t prev, uint8_t* out) {
+    uint8_t* control = out;
+    uint8_t* data = out + (n + 3) / 4;
+    memset(control, 0, (n + 3) / 4);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t z = (uint32_t)zigzag(in[i], prev);
+        prev = in[i];
+        int len = z < (1U << 8) ? 1 : z < (1U << 16) ? 2 : z < (1U << 24) ? 3 : 4;
+        control[i / 4] |= (uint8_t)((len - 1) << (2 * (i % 4)));
+        for (int b = 0; b < len; ++b) *data++ = (uint8_t)(z >> (8 * b));
+    }
+    return (size_t)(data - out);
+}
+
+static size_t leb128_encode(const uint64_t* in, size_t n, uint64_t prev, uint8_t* out) {
+    uint8_t* p = out;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t z = zigzag(in[i], prev);
+        prev = in[i];
+        while (z >= 0x80) {
+            *p++ = (uint8_t)(z | 0x80);
+            z >>= 7;
+        }
+        *p++ = (uint8_t)z;
+    }
+    return (size_t)(p - out);
+}
+
+uint32_t codec_encode(const uint64_t* in, size_t n, uint64_t base, uint8_t* out, size_t* bytes) {
+    uint64_t prev = base;
+    int fits32 = 1;
+    for (size_t i = 0; i < n && fits32; ++i) {
+        fits32 = zigzag(in[i], prev) <= UINT32_MAX;
+        prev = in[i];
+    }
+    if (fits32) {
+        *bytes = svb_encode(in, n, base, out);
+        return CODEC_STREAM_VBYTE;
+    }
+    *bytes = leb128_encode(in, n, base, out);
+    return CODEC_LEB128;
+}
+
+/**
+ * Scalar decode of one group of count (<= 4) deltas, 0 if it runs past end
+ */
+static int svb_decode_group(uint8_t control, const uint8_t** data, const uint8_t* end, size_t count,
+                            uint64_t* prev, uint64_t* out) {
+    const uint8_t* p = *data;
+    for (size_t k = 0; k < count; ++k) {
+        int len = ((control >> (2 * k)) & 3) + 1;
+        if (end - p < len) return 0;
+        uint32_t z = 0;
+        for (int b = 0; b < len; ++b) z |= (uint32_t)p[b] << (8 * b);
+        p += len;
+        *prev += (uint64_t)unzigzag(z);
+        out[k] = *prev;
+    }
+    *data = p;
+    return 1;
+}
+
+static int svb_decode_scalar(const uint8_t* in, size_t bytes, size_t n, uint64_t prev, uint64_t* out) {
+    size_t groups = (n + 3) / 4;
+    if (bytes < groups) return 0;
+    const uint8_t* data = in + groups;
+    const uint8_t* end = in + bytes;
+    for (size_t g = 0; g < groups; ++g) {
+        size_t count = n - 4 * g < 4 ? n - 4 * g : 4;
+        if (!svb_decode_group(in[g], &data, end, count, &prev, out + 4 * g)) return 0;
+    }
+    return data == end;
+}
+
+/**
+ * One pshufb spreads a group's bytes into 4 lanes, zigzag is undone in the vector,
+ * only the running 64-bit sum stays scalar
+ */
+__attribute__((target("ssse3")))
+static int svb_decode_ssse3(const uint8_t* in, size_t bytes, size_t n, uint64_t prev, uint64_t* out) {
+    size_t groups = (n + 3) / 4;
+    if (bytes < groups) return 0;
+    const uint8_t* data = in + groups;
+    const uint8_t* end = in + bytes;
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i zero = _mm_setzero_si128();
+    size_t g = 0;
+    // Full groups while a 16-byte load stays inside the input
+    for (; g < n / 4 && end - data >= 16; ++g) {
+        const uint8_t control = in[g];
+        __m128i packed = _mm_loadu_si128((const __m128i*)data);
+        __m128i z = _mm_shuffle_epi8(packed, _mm_loadu_si128((const __m128i*)svb_shuffle[control]));
+        __m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(zero, _mm_and_si128(z, one)));
+        int32_t deltas[4];
+        _mm_storeu_si128((__m128i*)deltas, d);
+        uint64_t* o = out + 4 * g;
+        o[0] = prev += (uint64_t)(int64_t)deltas[0];
+        o[1] = prev += (uint64_t)(int64_t)deltas[1];
+        o[2] = prev += (uint64_t)(int64_t)deltas[2];
+        o[3] = prev += (uint64_t)(int64_t)deltas[3];
+        data += svb_length[control];
+    }
+    for (; g < groups; ++g) {
+        size_t count = n - 4 * g < 4 ? n - 4 * g : 4;
+        if (!svb_decode_group(in[g], &data, end, count, &prev, out + 4 * g)) return 0;
+    }
+    return data == end;
+}
+
+static int leb128_decode(const uint8_t* in, size_t bytes, size_t n, uint64_t prev, uint64_t* out) {
+    const uint8_t* p = in;
+    const uint8_t* end = in + bytes;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t z = 0;
+        int shift = 0;
+        for (;;) {
+            if (p == end || shift > 63) return 0;
+            uint8_t byte = *p++;
+            z |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+            shift += 7;
+        }
+        prev += (uint64_t)unzigzag(z);
+        out[i] = prev;
+    }
+    return p == end;
+}
+
+int codec_decode(uint32_t encoding, const uint8_t* in, size_t bytes, size_t n, uint64_t base, uint64_t* out) {
+    if ((!in && bytes) || (!out && n)) return 0;
+    switch (encoding) {
+        case CODEC_STREAM_VBYTE:
+            pthread_once(&svb_once, svb_init_tables);
+            if (__builtin_cpu_supports("ssse3")) return svb_decode_ssse3(in, bytes, n, base, out);
+            return svb_decode_scalar(in, bytes, n, base, out);
+        case CODEC_LEB128:
+            return leb128_decode(in, bytes, n, base, out);
+        default:
+            return 0;
+    }
+}
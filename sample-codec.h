@@ -0,0 +1,33 @@
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Lossless packing of sample columns: every value becomes the zigzag-encoded
+ * difference to the previous one (the first to `base`), and the deltas are stored as
+ *   CODEC_STREAM_VBYTE: one control byte per 4 deltas (2 bits each: 1-4 bytes),
+ *                       then the delta bytes; decoded 4 at a time with SSSE3
+ *   CODEC_LEB128:       7 bits per byte, high bit set on all but the last byte
+ * Stream-VByte is picked whenever every delta fits in 32 bits.
+ */
+#define CODEC_STREAM_VBYTE 1
+#define CODEC_LEB128 2
+
+/**
+ * Largest encoding of n values, in bytes
+ */
+size_t codec_bound(size_t n);
+
+/**
+ * Encode n values into out (codec_bound(n) bytes). Returns the encoding, *bytes gets the size
+ */
+uint32_t codec_encode(const uint64_t* in, size_t n, uint64_t base, uint8_t* out, size_t* bytes);
+
+/**
+ * Decode n values. Returns 1 on success, 0 if the input is truncated or malformed
+ */
+int codec_decode(uint32_t encoding, const uint8_t* in, size_t bytes, size_t n, uint64_t base, uint64_t* out);
+
+#endif //SAMPLE_CODEC_H
@@ -0,0 +1,125 @@
+#include "shuffler.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void* shuffler_main(void* arg) {
+    bg_shuffler_t* sh = arg;
+    pin_to_core(sh->core);
+    prng_t rng; // private generator, mg->rng belongs to the probing thread
+
+    pthread_mutex_lock(&sh->lock);
+    for (;;) {
+        while (!sh->requested && !sh->stop) {
+            pthread_cond_wait(&sh->cond, &sh->lock);
+        }
+        if (sh->stop) break;
+        const int lane = sh->lane;
+        const uint64_t seed = sh->seed;
+        sh->requested = 0;
+        pthread_mutex_unlock(&sh->lock);
+
+        link_lane(sh->mg, lane, seed, &rng);
+
+        pthread_mutex_lock(&sh->lock);
+        sh->ready = 1;
+        pthread_cond_broadcast(&sh->cond);
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return NULL;
+}
+
+/**
+ * Ask for the inactive lane to be rebuilt with the next seed (caller holds no lock)
+ */
+static void request_build(bg_shuffler_t* sh) {
+    memorygrammer_t* mg = sh->mg;
+    pthread_mutex_lock(&sh->lock);
+    sh->lane = (mg->active_lane + 1) % NUM_LANES;
+    sh->seed = prng_next(&mg->seed_rng);
+    sh->ready = 0;
+    sh->requested = 1;
+    pthread_cond_broadcast(&sh->cond);
+    pthread_mutex_unlock(&sh->lock);
+}
+
+int start_background_shuffler(memorygrammer_t* mg, int core) {
+    if (!mg || !mg->nodes_arr || mg->shuffler) return 0;
+    if (mg->config->cache_line_size < NUM_LANES * sizeof(probe_node_t)) {
+        fprintf(stderr, "Cache line too small for %d link lanes\n", NUM_LANES);
+        return 0;
+    }
+
+    for (int lane = 0; lane < NUM_LANES; ++lane) {
+        if (mg->lane_orders[lane]) continue;
+        mg->lane_orders[lane] = malloc(mg->num_nodes * sizeof(probe_node_t*));
+        if (!mg->lane_orders[lane]) {
+            perror("Failed to allocate lane order");
+            return 0;
+        }
+    }
+
+    bg_shuffler_t* sh = calloc(1, sizeof(bg_shuffler_t));
+    if (!sh) {
+        perror("Failed to allocate shuffler");
+        return 0;
+    }
+    sh->mg = mg;
+    sh->core = core;
+    pthread_mutex_init(&sh->lock, NULL);
+    pthread_cond_init(&sh->cond, NULL);
+
+    if (pthread_create(&sh->thread, NULL, shuffler_main, sh) != 0) {
+        perror("Failed to start shuffler thread");
+        pthread_mutex_destroy(&sh->lock);
+        pthread_cond_destroy(&sh->cond);
+        free(sh);
+        return 0;
+    }
+    mg->shuffler = sh;
+    request_build(sh);
+    return 1;
+}
+
+void background_wait(memorygrammer_t* mg) {
+    if (!mg || !mg->shuffler) return;
+    bg_shuffler_t* sh = mg->shuffler;
+    pthread_mutex_lock(&sh->lock);
+    while (!sh->ready) {
+        pthread_cond_wait(&sh->cond, &sh->lock);
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+int background_swap(memorygrammer_t* mg) {
+    if (!mg || !mg->shuffler) return 0;
+    bg_shuffler_t* sh = mg->shuffler;
+
+    pthread_mutex_lock(&sh->lock);
+    while (!sh->ready) {
+        pthread_cond_wait(&sh->cond, &sh->lock);
+    }
+    const int lane = sh->lane;
+    const uint64_t seed = sh->seed;
+    pthread_mutex_unlock(&sh->lock);
+
+    activate_lane(mg, lane, seed);
+    request_build(sh);
+    return 1;
+}
+
+void stop_background_shuffler(memorygrammer_t* mg) {
+    if (!mg || !mg->shuffler) return;
+    bg_shuffler_t* sh = mg->shuffler;
+
+    pthread_mutex_lock(&sh->lock);
+    sh->stop = 1;
+    pthread_cond_broadcast(&sh->cond);
+    pthread_mutex_unlock(&sh->lock);
+    pthread_join(sh->thread, NULL);
+
+    pthread_mutex_destroy(&sh->lock);
+    pthread_cond_destroy(&sh->cond);
+    free(sh);
+    mg->shuffler = NULL;
+}
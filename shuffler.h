@@ -0,0 +1,46 @@
+#ifndef SHUFFLER_H
+#define SHUFFLER_H
+
+#include <pthread.h>
+#include "memorygrammer.h"
+
+/**
+ * Background thread that links the next random permutation into the inactive lane
+ * between probes. Both lanes share the probe lines, so every probe first waits for the
+ * build to finish; swapping lanes between rounds is then O(1).
+ */
+typedef struct bg_shuffler {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    memorygrammer_t* mg;
+    int core;                   // Core the shuffler is pinned to (should not be the probing core)
+    int lane;                   // Lane being built
+    uint64_t seed;              // Seed of the lane being built
+    int requested;              // A build was requested and not picked up yet
+    int ready;                  // The requested lane is linked and can be swapped in
+    int stop;                   // Ask the thread to exit
+} bg_shuffler_t;
+
+/**
+ * Allocate the second lane, start the shuffler on `core` and request the first build
+ */
+int start_background_shuffler(memorygrammer_t* mg, int core);
+
+/**
+ * Wait until the background lane is ready, make it active and request the next one
+ */
+int background_swap(memorygrammer_t* mg);
+
+/**
+ * Wait until the requested lane is linked, so its writes stay out of the timed window.
+ * No-op when no shuffler runs
+ */
+void background_wait(memorygrammer_t* mg);
+
+/**
+ * Stop and join the shuffler (no-op when none runs)
+ */
+void stop_background_shuffler(memorygrammer_t* mg);
+
+#endif //SHUFFLER_H
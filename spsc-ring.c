@@ -0,0 +1,29 @@
+#include "spsc-ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int spsc_init(spsc_ring_t* ring, size_t capacity) {
+    if (!ring || capacity == 0) return 0;
+    memset(ring, 0, sizeof(spsc_ring_t));
+
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    ring->records = aligned_alloc(SPSC_CACHE_LINE, size * sizeof(stream_record_t));
+    if (!ring->records) {
+        perror("Failed to allocate stream ring");
+        return 0;
+    }
+    memset(ring->records, 0, size * sizeof(stream_record_t)); // fault it in before the capture
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 1;
+}
+
+void spsc_free(spsc_ring_t* ring) {
+    if (!ring) return;
+    free(ring->records);
+    ring->records = NULL;
+    ring->mask = 0;
+}
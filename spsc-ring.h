@@ -0,0 +1,76 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPSC_CACHE_LINE 64
+
+/**
+ * One sweep of a continuous capture
+ */
+typedef struct {
+    uint64_t seq;               // Sample number since the capture started, gaps mean dropped records
+    uint64_t start_tsc;         // TSC at traversal start
+    uint64_t cycles;            // Sweep duration
+    uint64_t reserved;
+} stream_record_t;
+
+/**
+ * Wait-free single-producer/single-consumer ring of stream records.
+ * Producer and consumer indices live on separate cache lines, and each side keeps
+ * a cached copy of the other's index so the shared lines are only read when needed.
+ */
+typedef struct {
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t head;      // Next slot to write (producer)
+    size_t cached_tail;                                 // Producer's view of tail
+    uint64_t dropped;                                   // Records dropped because the ring was full (producer)
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t tail;      // Next slot to read (consumer)
+    size_t cached_head;                                 // Consumer's view of head
+    _Alignas(SPSC_CACHE_LINE) stream_record_t* records;
+    size_t mask;                                        // capacity - 1 (capacity is a power of two)
+} spsc_ring_t;
+
+/**
+ * capacity is rounded up to a power of two
+ */
+int spsc_init(spsc_ring_t* ring, size_t capacity);
+void spsc_free(spsc_ring_t* ring);
+
+/**
+ * Producer: never blocks, a full ring drops the record and counts it
+ */
+static inline int spsc_push(spsc_ring_t* ring, const stream_record_t* record) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->cached_tail > ring->mask) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail > ring->mask) {
+            ring->dropped++;
+            return 0;
+        }
+    }
+    ring->records[head & ring->mask] = *record;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * Consumer: copies up to max records into out, returns how many
+ */
+static inline size_t spsc_pop_batch(spsc_ring_t* ring, stream_record_t* out, size_t max) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (ring->cached_head == tail) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (ring->cached_head == tail) return 0;
+    }
+    size_t count = ring->cached_head - tail;
+    if (count > max) count = max;
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = ring->records[(tail + i) & ring->mask];
+    }
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+#endif //SPSC_RING_H
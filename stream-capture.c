@@ -0,0 +1,111 @@
+#include "stream-capture.h"
+#include "utils.h"
+#include "shuffler.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IDLE_SLEEP_NS 1000000 // consumer naps 1ms when the ring is empty
+
+static void write_records(int fd, const stream_record_t* records, size_t count) {
+    const uint8_t* p = (const uint8_t*)records;
+    size_t size = count * sizeof(stream_record_t);
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write stream");
+            return;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+}
+
+/**
+ * Pops one batch and hands it on, returns the number of records
+ */
+static size_t drain_batch(stream_consumer_t* consumer, stream_record_t* batch) {
+    size_t count = spsc_pop_batch(consumer->ring, batch, STREAM_BATCH);
+    if (count == 0) return 0;
+    if (consumer->fd >= 0) write_records(consumer->fd, batch, count);
+    if (consumer->callback) consumer->callback(batch, count, consumer->ctx);
+    consumer->consumed += count;
+    return count;
+}
+
+static void* consumer_main(void* arg) {
+    stream_consumer_t* consumer = arg;
+    if (consumer->core >= 0) pin_to_core(consumer->core);
+    stream_record_t* batch = malloc(STREAM_BATCH * sizeof(stream_record_t));
+    if (!batch) {
+        perror("Failed to allocate stream batch");
+        return NULL;
+    }
+    const struct timespec idle = {0, IDLE_SLEEP_NS};
+
+    while (!atomic_load_explicit(&consumer->stop, memory_order_acquire)) {
+        if (drain_batch(consumer, batch) == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    while (drain_batch(consumer, batch) > 0); // whatever the producer left behind
+
+    free(batch);
+    return NULL;
+}
+
+int stream_consumer_start(stream_consumer_t* consumer, spsc_ring_t* ring, int fd,
+                          stream_callback_t callback, void* ctx, int core) {
+    if (!consumer || !ring) return 0;
+    memset(consumer, 0, sizeof(stream_consumer_t));
+    consumer->ring = ring;
+    consumer->fd = fd;
+    consumer->callback = callback;
+    consumer->ctx = ctx;
+    consumer->core = core;
+    atomic_init(&consumer->stop, 0);
+
+    if (pthread_create(&consumer->thread, NULL, consumer_main, consumer) != 0) {
+        perror("Failed to start stream consumer");
+        return 0;
+    }
+    return 1;
+}
+
+void stream_consumer_stop(stream_consumer_t* consumer) {
+    if (!consumer || !consumer->ring) return;
+    atomic_store_explicit(&consumer->stop, 1, memory_order_release);
+    pthread_join(consumer->thread, NULL);
+    consumer->ring = NULL;
+}
+
+void run_probe_continuous(memorygrammer_t* mg, uint64_t interval_cycles, spsc_ring_t* ring, atomic_int* stop) {
+    if (!mg || !mg->head || !ring || !stop) return;
+    const uint64_t overhead = mg->config->timer.overhead_cycles;
+    stream_record_t record;
+    memset(&record, 0, sizeof(stream_record_t));
+    background_wait(mg); // no lane rebuild may write the lines we are about to walk
+    mg->timeline_start = rdtscp64();
+
+    while (!atomic_load_explicit(stop, memory_order_relaxed)) {
+        uint64_t t_target = rdtscp64() + interval_cycles;
+
+        uint64_t traverse_start = rdtscp64();
+        volatile probe_node_t* curr = mg->head;
+        for (size_t j = 0; j < mg->num_nodes; ++j) {
+            curr = curr->next;
+        }
+        uint64_t traverse_end = rdtscp64();
+
+        record.start_tsc = traverse_start;
+        record.cycles = tsc_elapsed(traverse_start, traverse_end, overhead);
+        spsc_push(ring, &record);
+        record.seq++;
+
+        while (rdtscp64() < t_target);
+    }
+}
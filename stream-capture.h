@@ -0,0 +1,44 @@
+#ifndef STREAM_CAPTURE_H
+#define STREAM_CAPTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "memorygrammer.h"
+#include "spsc-ring.h"
+
+#define STREAM_BATCH 4096 // records drained per write
+
+/**
+ * Called by the consumer for every drained batch (analysis hook)
+ */
+typedef void (*stream_callback_t)(const stream_record_t* records, size_t count, void* ctx);
+
+/**
+ * Consumer thread draining a stream ring to a file descriptor and/or a callback
+ */
+typedef struct {
+    spsc_ring_t* ring;
+    int fd;                     // Raw stream_record_t array is appended here, -1 for none
+    stream_callback_t callback; // NULL for none
+    void* ctx;
+    int core;                   // Core the consumer is pinned to, -1 for no pinning
+    atomic_int stop;
+    pthread_t thread;
+    uint64_t consumed;          // Records drained so far
+} stream_consumer_t;
+
+int stream_consumer_start(stream_consumer_t* consumer, spsc_ring_t* ring, int fd,
+                          stream_callback_t callback, void* ctx, int core);
+
+/**
+ * Drain what is left in the ring, then join the thread
+ */
+void stream_consumer_stop(stream_consumer_t* consumer);
+
+/**
+ * Probe until *stop becomes non-zero, pushing one record per sweep into ring.
+ * Never allocates or blocks: a full ring drops the record (ring->dropped).
+ */
+void run_probe_continuous(memorygrammer_t* mg, uint64_t interval_cycles, spsc_ring_t* ring, atomic_int* stop);
+
+#endif //STREAM_CAPTURE_H
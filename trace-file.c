@@ -0,0 +1,517 @@
+#include "trace-file.h"
+#include "sample-codec.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INITIAL_INDEX_CAPACITY 64
+
+static size_t pad8(size_t bytes) {
+    return (bytes + 7) & ~(size_t)7;
+}
+
+/**
+ * Bytes taken by one column of a block
+ */
+static size_t column_bytes(uint32_t column, uint64_t num_samples, uint32_t num_segments) {
+    switch (column) {
+        case TRACE_COL_TIMINGS:
+        case TRACE_COL_START_TSC:
+        case TRACE_COL_SLOTS:
+            return num_samples * sizeof(uint64_t);
+        case TRACE_COL_SUBSETS:
+            return pad8(num_samples * sizeof(uint32_t));
+        case TRACE_COL_COUNTERS:
+            return num_samples * sizeof(perf_sample_t);
+        case TRACE_COL_SEGMENTS:
+            return pad8(num_samples * num_segments * sizeof(uint32_t));
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Bytes of one sample in a column
+ */
+static size_t element_bytes(uint32_t column, uint32_t num_segments) {
+    switch (column) {
+        case TRACE_COL_TIMINGS:
+        case TRACE_COL_START_TSC:
+        case TRACE_COL_SLOTS:
+            return sizeof(uint64_t);
+        case TRACE_COL_SUBSETS:
+            return sizeof(uint32_t);
+        case TRACE_COL_COUNTERS:
+            return sizeof(perf_sample_t);
+        case TRACE_COL_SEGMENTS:
+            return num_segments * sizeof(uint32_t);
+        default:
+            return 0;
+    }
+}
+
+static int is_packed(const trace_block_t* block, uint32_t column) {
+    return (block->columns & TRACE_PACKED) && (column & TRACE_PACKABLE);
+}
+
+/**
+ * Offset of a column from the start of its block, 0 if it is missing or runs past the block
+ */
+static size_t column_offset(const trace_block_t* block, uint32_t column) {
+    if (!block || !(block->columns & column)) return 0;
+    const uint8_t* base = (const uint8_t*)block;
+    size_t offset = sizeof(trace_block_t);
+    for (uint32_t c = 1; c <= column; c <<= 1) {
+        if (!(block->columns & c)) continue;
+        size_t stored;
+        if (is_packed(block, c)) {
+            if (block->block_size - offset < sizeof(trace_packed_column_t)) return 0;
+            const trace_packed_column_t* head = (const trace_packed_column_t*)(base + offset);
+            if (head->bytes > block->block_size) return 0;
+            stored = sizeof(trace_packed_column_t) + pad8(head->bytes);
+        } else {
+            stored = column_bytes(c, block->num_samples, block->num_segments);
+        }
+        if (stored > block->block_size - offset) return 0;
+        if (c == column) return offset;
+        offset += stored;
+    }
+    return 0;
+}
+
+static void snapshot_config(trace_config_t* out, const cpu_config_t* config) {
+    memset(out, 0, sizeof(trace_config_t));
+    out->llc_size_bytes = config->llc_size_bytes;
+    out->cache_line_size = config->cache_line_size;
+    out->sets_per_slice = config->sets_per_slice;
+    out->hugepage_size_kb = config->hugepage_size_kb;
+    out->tsc_hz = config->timer.tsc_hz;
+    out->rdtscp_overhead = config->timer.overhead_cycles;
+    out->llc_associativity = config->llc_associativity;
+    out->num_logical_processors = config->num_logical_processors;
+    out->has_hyperthreading = config->has_hyperthreading;
+    out->hugepages_total = config->hugepages_total;
+    out->hugepages_free = config->hugepages_free;
+    out->invariant_tsc = config->timer.invariant;
+    out->clock_speed_hz = config->clock_speed_hz;
+    memcpy(out->model_name, config->model_name, sizeof(out->model_name));
+}
+
+static void snapshot_latency(trace_latency_t* out, const cache_latency_t* latency) {
+    memset(out, 0, sizeof(trace_latency_t));
+    if (!latency->calibrated) return;
+    memcpy(out->load_cycles, latency->load_cycles, sizeof(out->load_cycles));
+    out->miss_threshold = latency->miss_threshold;
+    out->clean_sweep_cycles = latency->clean_sweep_cycles;
+    out->calibrated = 1;
+}
+
+static int write_all(int fd, const void* buf, size_t size, uint64_t offset) {
+    const uint8_t* p = buf;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write trace");
+            return 0;
+        }
+        p += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 1;
+}
+
+static int add_index_entry(trace_writer_t* tw, uint64_t round, uint64_t offset) {
+    if (tw->num_rounds == tw->index_capacity) {
+        size_t capacity = tw->index_capacity ? tw->index_capacity * 2 : INITIAL_INDEX_CAPACITY;
+        trace_index_entry_t* index = realloc(tw->index, capacity * sizeof(trace_index_entry_t));
+        if (!index) {
+            perror("Failed to grow trace index");
+            return 0;
+        }
+        tw->index = index;
+        tw->index_capacity = capacity;
+    }
+    tw->index[tw->num_rounds].round = round;
+    tw->index[tw->num_rounds].offset = offset;
+    tw->num_rounds++;
+    return 1;
+}
+
+/**
+ * Rebuild the index of an existing file: from its footer if intact,
+ * otherwise by walking the blocks. Leaves tw->offset after the last complete block.
+ */
+static int recover_index(trace_writer_t* tw, const uint8_t* map, size_t size) {
+    const trace_header_t* header = (const trace_header_t*)map;
+    uint64_t offset = header->header_size;
+
+    if (size >= offset + sizeof(trace_footer_t)) {
+        const trace_footer_t* footer = (const trace_footer_t*)(map + size - sizeof(trace_footer_t));
+        if (memcmp(footer->magic, TRACE_INDEX_MAGIC, sizeof(footer->magic)) == 0 &&
+            footer->index_offset + footer->num_rounds * sizeof(trace_index_entry_t) + sizeof(trace_footer_t) == size) {
+            const trace_index_entry_t* index = (const trace_index_entry_t*)(map + footer->index_offset);
+            for (uint64_t i = 0; i < footer->num_rounds; ++i) {
+                if (!add_index_entry(tw, index[i].round, index[i].offset)) return 0;
+            }
+            tw->offset = footer->index_offset;
+            return 1;
+        }
+    }
+
+    // No usable footer: walk the length-prefixed blocks
+    while (offset + sizeof(trace_block_t) <= size) {
+        const trace_block_t* block = (const trace_block_t*)(map + offset);
+        if (block->magic != TRACE_BLOCK_MAGIC || block->block_size < sizeof(trace_block_t) ||
+            offset + block->block_size > size) {
+            break;
+        }
+        if (!add_index_entry(tw, block->round, offset)) return 0;
+        offset += block->block_size;
+    }
+    tw->offset = offset;
+    return 1;
+}
+
+int trace_open(trace_writer_t* tw, const char* path, const cpu_config_t* config,
+               uint64_t interval_cycles, uint64_t probe_cycles, const char* site) {
+    if (!tw || !path || !config) return 0;
+    memset(tw, 0, sizeof(trace_writer_t));
+
+    tw->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (tw->fd < 0) {
+        perror("Failed to open trace file");
+        return 0;
+    }
+    struct stat st;
+    if (fstat(tw->fd, &st) != 0) {
+        perror("Failed to stat trace file");
+        close(tw->fd);
+        return 0;
+    }
+
+    if ((size_t)st.st_size >= offsetof(trace_header_t, latency)) {
+        // Existing trace: keep its header and append after the last round
+        const uint8_t* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, tw->fd, 0);
+        if (map == MAP_FAILED) {
+            perror("Failed to map trace file");
+            close(tw->fd);
+            return 0;
+        }
+        const trace_header_t* header = (const trace_header_t*)map;
+        uint32_t version = header->version;
+        int upgrade = version < TRACE_VERSION;
+        int ok = memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0 &&
+                 version >= TRACE_MIN_VERSION && version <= TRACE_VERSION &&
+                 recover_index(tw, map, st.st_size);
+        munmap((void*)map, st.st_size);
+        if (!ok) {
+            fprintf(stderr, "%s is not a version %d-%d trace file\n", path, TRACE_MIN_VERSION, TRACE_VERSION);
+            free(tw->index);
+            close(tw->fd);
+            return 0;
+        }
+        // Older files are a subset of the current format, appended rounds may be packed
+        version = TRACE_VERSION;
+        if (upgrade && !write_all(tw->fd, &version, sizeof(version), offsetof(trace_header_t, version))) {
+            free(tw->index);
+            close(tw->fd);
+            return 0;
+        }
+        // Drop the old index and footer, they get rewritten on close
+        if (ftruncate(tw->fd, (off_t)tw->offset) != 0) {
+            perror("Failed to truncate trace file");
+        }
+        return 1;
+    }
+
+    trace_header_t header;
+    memset(&header, 0, sizeof(trace_header_t));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.header_size = sizeof(trace_header_t);
+    snapshot_config(&header.config, config);
+    snapshot_latency(&header.latency, &config->latency);
+    header.interval_cycles = interval_cycles;
+    header.probe_cycles = probe_cycles;
+    if (site) strncpy(header.site, site, TRACE_SITE_LEN - 1);
+
+    if (ftruncate(tw->fd, 0) != 0 || !write_all(tw->fd, &header, sizeof(header), 0)) {
+        close(tw->fd);
+        return 0;
+    }
+    tw->offset = sizeof(trace_header_t);
+    return 1;
+}
+
+/**
+ * Columns carried by the last probe of mg
+ */
+static uint32_t probe_columns(const memorygrammer_t* mg) {
+    uint32_t columns = TRACE_COL_TIMINGS | TRACE_COL_START_TSC | TRACE_COL_SLOTS | TRACE_COL_SUBSETS;
+    if (mg->perf && mg->counters) columns |= TRACE_COL_COUNTERS;
+    if (mg->segments && mg->num_segments) columns |= TRACE_COL_SEGMENTS;
+    return columns;
+}
+
+size_t trace_block_size(const memorygrammer_t* mg, uint32_t* columns) {
+    uint32_t present = probe_columns(mg);
+    size_t size = sizeof(trace_block_t);
+    for (uint32_t column = 1; column <= TRACE_COL_SEGMENTS; column <<= 1) {
+        if (present & column) size += column_bytes(column, mg->num_samples, (uint32_t)mg->num_segments);
+    }
+    if (columns) *columns = present;
+    return size;
+}
+
+/**
+ * Copies a ring-ordered column out in chronological order (at most two memcpys)
+ */
+static uint8_t* copy_column(uint8_t* dst, const void* src, size_t elem_size, const memorygrammer_t* mg, size_t padded) {
+    size_t first = mg->num_samples ? sample_index(mg, 0) : 0;
+    size_t head = mg->num_samples < mg->capacity - first ? mg->num_samples : mg->capacity - first;
+    memcpy(dst, (const uint8_t*)src + first * elem_size, head * elem_size);
+    memcpy(dst + head * elem_size, src, (mg->num_samples - head) * elem_size);
+    size_t used = mg->num_samples * elem_size;
+    memset(dst + used, 0, padded - used);
+    return dst + padded;
+}
+
+void trace_serialize_round(const memorygrammer_t* mg, uint64_t round, void* buf) {
+    uint32_t columns;
+    size_t size = trace_block_size(mg, &columns);
+    const uint32_t num_segments = (uint32_t)mg->num_segments;
+    const uint64_t n = mg->num_samples;
+
+    trace_block_t* block = buf;
+    memset(block, 0, sizeof(trace_block_t));
+    block->magic = TRACE_BLOCK_MAGIC;
+    block->columns = columns;
+    block->block_size = size;
+    block->round = round;
+    block->seed = mg->probe_seed;
+    block->num_samples = n;
+    block->timeline_start = mg->timeline_start;
+    block->overruns = mg->overruns;
+    block->skipped_slots = mg->skipped_slots;
+    block->num_subsets = (uint32_t)mg->probe_subsets;
+    block->num_segments = (columns & TRACE_COL_SEGMENTS) ? num_segments : 0;
+
+    uint8_t* p = (uint8_t*)(block + 1);
+    p = copy_column(p, mg->timings, sizeof(uint64_t), mg, column_bytes(TRACE_COL_TIMINGS, n, 0));
+    p = copy_column(p, mg->start_tsc, sizeof(uint64_t), mg, column_bytes(TRACE_COL_START_TSC, n, 0));
+    p = copy_column(p, mg->slots, sizeof(uint64_t), mg, column_bytes(TRACE_COL_SLOTS, n, 0));
+    p = copy_column(p, mg->subset_ids, sizeof(uint32_t), mg, column_bytes(TRACE_COL_SUBSETS, n, 0));
+    if (columns & TRACE_COL_COUNTERS) {
+        p = copy_column(p, mg->counters, sizeof(perf_sample_t), mg, column_bytes(TRACE_COL_COUNTERS, n, 0));
+    }
+    if (columns & TRACE_COL_SEGMENTS) {
+        copy_column(p, mg->segments, num_segments * sizeof(uint32_t), mg,
+                    column_bytes(TRACE_COL_SEGMENTS, n, num_segments));
+    }
+}
+
+size_t trace_packed_bound(const void* block) {
+    const trace_block_t* in = block;
+    size_t size = sizeof(trace_block_t);
+    for (uint32_t column = 1; column <= TRACE_COL_SEGMENTS; column <<= 1) {
+        if (!(in->columns & column)) continue;
+        if (column & TRACE_PACKABLE) {
+            size += sizeof(trace_packed_column_t) + pad8(codec_bound(in->num_samples));
+        } else {
+            size += column_bytes(column, in->num_samples, in->num_segments);
+        }
+    }
+    return size;
+}
+
+size_t trace_pack_block(const void* block, void* out) {
+    const trace_block_t* in = block;
+    if (!in || !out || (in->columns & TRACE_PACKED)) return 0;
+    const size_t n = in->num_samples;
+    uint64_t* wide = NULL;      // uint32_t columns are widened for the codec
+    if ((in->columns & TRACE_COL_SUBSETS) && n) {
+        wide = malloc(n * sizeof(uint64_t));
+        if (!wide) return 0;
+    }
+
+    trace_block_t* packed = out;
+    memcpy(packed, in, sizeof(trace_block_t));
+    const uint8_t* src = (const uint8_t*)(in + 1);
+    uint8_t* dst = (uint8_t*)(packed + 1);
+    for (uint32_t column = 1; column <= TRACE_COL_SEGMENTS; column <<= 1) {
+        if (!(in->columns & column)) continue;
+        size_t raw = column_bytes(column, n, in->num_segments);
+        if (column & TRACE_PACKABLE) {
+            const uint64_t* values = (const uint64_t*)src;
+            if (column == TRACE_COL_SUBSETS) {
+                const uint32_t* narrow = (const uint32_t*)src;
+                for (size_t i = 0; i < n; ++i) wide[i] = narrow[i];
+                values = wide;
+            }
+            trace_packed_column_t* head = (trace_packed_column_t*)dst;
+            size_t bytes;
+            head->base = n ? values[0] : 0;
+            head->encoding = codec_encode(values, n, head->base, dst + sizeof(trace_packed_column_t), &bytes);
+            head->reserved = 0;
+            head->bytes = bytes;
+            dst += sizeof(trace_packed_column_t);
+            memset(dst + bytes, 0, pad8(bytes) - bytes);
+            dst += pad8(bytes);
+        } else {
+            memcpy(dst, src, raw);
+            dst += raw;
+        }
+        src += raw;
+    }
+    free(wide);
+    packed->columns |= TRACE_PACKED;
+    packed->block_size = (uint64_t)(dst - (uint8_t*)out);
+    return packed->block_size < in->block_size ? packed->block_size : 0;
+}
+
+int trace_commit_block(trace_writer_t* tw, const void* block) {
+    if (!tw || !block) return 0;
+    const trace_block_t* header = block;
+    if (!add_index_entry(tw, header->round, tw->offset)) return 0;
+    tw->offset += header->block_size;
+    return 1;
+}
+
+int trace_truncate(trace_writer_t* tw, size_t num_rounds) {
+    if (!tw || tw->fd < 0) return 0;
+    if (num_rounds >= tw->num_rounds) return 1;
+    tw->offset = tw->index[num_rounds].offset;
+    tw->num_rounds = num_rounds;
+    if (ftruncate(tw->fd, (off_t)tw->offset) != 0) {
+        perror("Failed to truncate trace file");
+        return 0;
+    }
+    return 1;
+}
+
+int trace_append_block(trace_writer_t* tw, const void* block, size_t size) {
+    if (!tw || tw->fd < 0 || !block) return 0;
+    if (!write_all(tw->fd, block, size, tw->offset)) return 0;
+    return trace_commit_block(tw, block);
+}
+
+int trace_write_round(trace_writer_t* tw, const memorygrammer_t* mg, uint64_t round) {
+    if (!tw || !mg || !mg->timings) return 0;
+    size_t size = trace_block_size(mg, NULL);
+    if (size > tw->scratch_size) {
+        void* scratch = realloc(tw->scratch, size);
+        if (!scratch) {
+            perror("Failed to allocate trace buffer");
+            return 0;
+        }
+        tw->scratch = scratch;
+        tw->scratch_size = size;
+    }
+    trace_serialize_round(mg, round, tw->scratch);
+    return trace_append_block(tw, tw->scratch, size);
+}
+
+int trace_close(trace_writer_t* tw) {
+    if (!tw || tw->fd < 0) return 0;
+
+    trace_footer_t footer;
+    memset(&footer, 0, sizeof(trace_footer_t));
+    memcpy(footer.magic, TRACE_INDEX_MAGIC, sizeof(TRACE_INDEX_MAGIC));
+    footer.num_rounds = tw->num_rounds;
+    footer.index_offset = tw->offset;
+
+    size_t index_bytes = tw->num_rounds * sizeof(trace_index_entry_t);
+    int ok = write_all(tw->fd, tw->index, index_bytes, tw->offset) &&
+             write_all(tw->fd, &footer, sizeof(footer), tw->offset + index_bytes);
+
+    close(tw->fd);
+    free(tw->index);
+    free(tw->scratch);
+    memset(tw, 0, sizeof(trace_writer_t));
+    tw->fd = -1;
+    return ok;
+}
+
+int trace_map(trace_reader_t* tr, const char* path) {
+    if (!tr || !path) return 0;
+    memset(tr, 0, sizeof(trace_reader_t));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open trace file");
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < offsetof(trace_header_t, latency) + sizeof(trace_footer_t)) {
+        fprintf(stderr, "%s is too small for a trace file\n", path);
+        close(fd);
+        return 0;
+    }
+    const uint8_t* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map trace file");
+        return 0;
+    }
+
+    const trace_header_t* header = (const trace_header_t*)map;
+    const trace_footer_t* footer = (const trace_footer_t*)(map + st.st_size - sizeof(trace_footer_t));
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        header->version < TRACE_MIN_VERSION || header->version > TRACE_VERSION ||
+        memcmp(footer->magic, TRACE_INDEX_MAGIC, sizeof(TRACE_INDEX_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a closed version %d-%d trace file\n", path, TRACE_MIN_VERSION, TRACE_VERSION);
+        munmap((void*)map, st.st_size);
+        return 0;
+    }
+
+    tr->map = map;
+    tr->size = st.st_size;
+    tr->header = header;
+    tr->index = (const trace_index_entry_t*)(map + footer->index_offset);
+    tr->num_rounds = footer->num_rounds;
+    return 1;
+}
+
+const trace_block_t* trace_round(const trace_reader_t* tr, size_t i) {
+    if (!tr || i >= tr->num_rounds) return NULL;
+    return (const trace_block_t*)(tr->map + tr->index[i].offset);
+}
+
+const void* trace_column(const trace_block_t* block, uint32_t column) {
+    if (!block || is_packed(block, column)) return NULL;
+    size_t offset = column_offset(block, column);
+    return offset ? (const uint8_t*)block + offset : NULL;
+}
+
+int trace_read_column(const trace_block_t* block, uint32_t column, void* out) {
+    size_t offset = column_offset(block, column);
+    if (!offset || !out) return 0;
+    const uint8_t* p = (const uint8_t*)block + offset;
+    const size_t n = block->num_samples;
+    if (!is_packed(block, column)) {
+        memcpy(out, p, n * element_bytes(column, block->num_segments));
+        return 1;
+    }
+    const trace_packed_column_t* head = (const trace_packed_column_t*)p;
+    const uint8_t* payload = p + sizeof(trace_packed_column_t);
+    if (column != TRACE_COL_SUBSETS) return codec_decode(head->encoding, payload, head->bytes, n, head->base, out);
+
+    uint64_t* wide = malloc((n ? n : 1) * sizeof(uint64_t));
+    int ok = wide && codec_decode(head->encoding, payload, head->bytes, n, head->base, wide);
+    for (size_t i = 0; ok && i < n; ++i) ((uint32_t*)out)[i] = (uint32_t)wide[i];
+    free(wide);
+    return ok;
+}
+
+void trace_unmap(trace_reader_t* tr) {
+    if (!tr || !tr->map) return;
+    munmap((void*)tr->map, tr->size);
+    memset(tr, 0, sizeof(trace_reader_t));
+}
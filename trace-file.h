@@ -0,0 +1,208 @@
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "memorygrammer.h"
+
+/**
+ * Binary trace file (little-endian, all fields fixed width):
+ *   trace_header_t | round block | round block | ... | index entries | trace_footer_t
+ * A round block is a trace_block_t followed by its columns, each num_samples long,
+ * in the order of the TRACE_COL_* bits. Every column is padded to 8 bytes.
+ * The footer sits at the very end and points at the index, so the file can be
+ * mmap'ed and any round reached directly.
+ * Since version 2 a block with TRACE_PACKED set stores its TRACE_PACKABLE columns as a
+ * trace_packed_column_t followed by the sample-codec.h payload, padded to 8 bytes.
+ */
+#define TRACE_MAGIC "MGTRACE"
+#define TRACE_INDEX_MAGIC "MGTRIDX"
+#define TRACE_BLOCK_MAGIC 0x4252474DU // "MGRB"
+#define TRACE_VERSION 2
+#define TRACE_MIN_VERSION 1     // Version 1 files have no packed blocks and are still read
+#define TRACE_SITE_LEN 64
+
+// Column bits of a round block
+#define TRACE_COL_TIMINGS   (1U << 0) // uint64_t sweep cycles
+#define TRACE_COL_START_TSC (1U << 1) // uint64_t traversal start TSC
+#define TRACE_COL_SLOTS     (1U << 2) // uint64_t intended slot
+#define TRACE_COL_SUBSETS   (1U << 3) // uint32_t probed sub-chain
+#define TRACE_COL_COUNTERS  (1U << 4) // perf_sample_t counter deltas
+#define TRACE_COL_SEGMENTS  (1U << 5) // uint32_t[num_segments] sub-sweep durations
+#define TRACE_PACKED        (1U << 31) // Flag: the TRACE_PACKABLE columns are delta + varint packed
+#define TRACE_PACKABLE (TRACE_COL_TIMINGS | TRACE_COL_START_TSC | TRACE_COL_SLOTS | TRACE_COL_SUBSETS)
+
+/**
+ * cpu_config_t snapshot with fixed-width fields
+ */
+typedef struct {
+    uint64_t llc_size_bytes;
+    uint64_t cache_line_size;
+    uint64_t sets_per_slice;
+    uint64_t hugepage_size_kb;
+    uint64_t tsc_hz;
+    uint64_t rdtscp_overhead;
+    int32_t llc_associativity;
+    int32_t num_logical_processors;
+    int32_t has_hyperthreading;
+    int32_t hugepages_total;
+    int32_t hugepages_free;
+    int32_t invariant_tsc;
+    uint32_t clock_speed_hz;
+    uint32_t reserved;
+    char model_name[128];
+} trace_config_t;
+
+/**
+ * cache_latency_t snapshot with fixed-width fields
+ */
+typedef struct {
+    double load_cycles[LATENCY_LEVELS];
+    double miss_threshold;
+    uint64_t clean_sweep_cycles;
+    uint32_t calibrated;        // 0: the run was not calibrated, the fields are 0
+    uint32_t reserved;
+} trace_latency_t;
+
+typedef struct {
+    char magic[8];              // TRACE_MAGIC
+    uint32_t version;           // TRACE_VERSION
+    uint32_t header_size;       // sizeof(trace_header_t), blocks start here
+    trace_config_t config;
+    uint64_t interval_cycles;
+    uint64_t probe_cycles;
+    char site[TRACE_SITE_LEN];  // Site label of every round in the file
+    trace_latency_t latency;    // Only present if header_size covers it
+} trace_header_t;
+
+typedef struct {
+    uint32_t magic;             // TRACE_BLOCK_MAGIC
+    uint32_t columns;           // TRACE_COL_* bits present in the block
+    uint64_t block_size;        // Bytes of the whole block, header included (length prefix)
+    uint64_t round;
+    uint64_t seed;              // Seed of the permutation that was probed
+    uint64_t num_samples;
+    uint64_t timeline_start;    // TSC of slot 0
+    uint64_t overruns;
+    uint64_t skipped_slots;
+    uint32_t num_subsets;       // Sub-chains rotated through (1 for full sweeps)
+    uint32_t num_segments;      // Row length of TRACE_COL_SEGMENTS
+} trace_block_t;
+
+/**
+ * Head of a packed column, its encoded bytes follow
+ */
+typedef struct {
+    uint32_t encoding;          // CODEC_* of sample-codec.h
+    uint32_t reserved;
+    uint64_t base;              // The first delta is taken from this value
+    uint64_t bytes;             // Encoded size, before the padding to 8 bytes
+} trace_packed_column_t;
+
+typedef struct {
+    uint64_t round;
+    uint64_t offset;            // File offset of the round's trace_block_t
+} trace_index_entry_t;
+
+typedef struct {
+    char magic[8];              // TRACE_INDEX_MAGIC
+    uint64_t num_rounds;
+    uint64_t index_offset;      // File offset of the first trace_index_entry_t
+} trace_footer_t;
+
+/**
+ * Appends round blocks to a trace file and keeps the index in memory
+ */
+typedef struct {
+    int fd;
+    uint64_t offset;            // Where the next block goes
+    trace_index_entry_t* index;
+    size_t num_rounds;
+    size_t index_capacity;
+    void* scratch;              // Reused serialization buffer of trace_write_round()
+    size_t scratch_size;
+} trace_writer_t;
+
+/**
+ * Read-only mapping of a trace file
+ */
+typedef struct {
+    const uint8_t* map;
+    size_t size;
+    const trace_header_t* header;
+    const trace_index_entry_t* index;
+    size_t num_rounds;
+} trace_reader_t;
+
+/**
+ * Create a trace file, or reopen an existing one to append rounds.
+ * An existing file keeps its header; a missing footer (e.g. after a crash)
+ * is rebuilt by walking the length-prefixed blocks.
+ */
+int trace_open(trace_writer_t* tw, const char* path, const cpu_config_t* config,
+               uint64_t interval_cycles, uint64_t probe_cycles, const char* site);
+
+/**
+ * Drop every round after the first num_rounds (rounds written but never recorded as done)
+ */
+int trace_truncate(trace_writer_t* tw, size_t num_rounds);
+
+/**
+ * Size of a round block holding the columns of the last probe
+ */
+size_t trace_block_size(const memorygrammer_t* mg, uint32_t* columns);
+
+/**
+ * Serialize the last probe of mg into buf (trace_block_size() bytes): memcpy only
+ */
+void trace_serialize_round(const memorygrammer_t* mg, uint64_t round, void* buf);
+
+/**
+ * Append the last probe of mg as one round block
+ */
+int trace_write_round(trace_writer_t* tw, const memorygrammer_t* mg, uint64_t round);
+
+/**
+ * Append an already serialized round block at the end of the file
+ */
+int trace_append_block(trace_writer_t* tw, const void* block, size_t size);
+
+/**
+ * Size a packed copy of a serialized (unpacked) block can take at most
+ */
+size_t trace_packed_bound(const void* block);
+
+/**
+ * Pack the TRACE_PACKABLE columns of a serialized block into out (trace_packed_bound() bytes).
+ * Returns the size of the packed block, 0 if packing would not make it smaller
+ */
+size_t trace_pack_block(const void* block, void* out);
+
+/**
+ * Record a block that was already written at tw->offset (e.g. by a batched pwritev)
+ * in the index and move past it
+ */
+int trace_commit_block(trace_writer_t* tw, const void* block);
+
+/**
+ * Write the index and the footer, then close the file
+ */
+int trace_close(trace_writer_t* tw);
+
+int trace_map(trace_reader_t* tr, const char* path);
+const trace_block_t* trace_round(const trace_reader_t* tr, size_t i);
+
+/**
+ * Start of a column inside a block, NULL if the block doesn't carry it or it is packed
+ */
+const void* trace_column(const trace_block_t* block, uint32_t column);
+
+/**
+ * Copy a column out of a block, unpacking it if needed. out holds num_samples
+ * elements of the column (num_samples * num_segments for TRACE_COL_SEGMENTS).
+ * Returns 1 on success, 0 if the column is missing or corrupt
+ */
+int trace_read_column(const trace_block_t* block, uint32_t column, void* out);
+void trace_unmap(trace_reader_t* tr);
+
+#endif //TRACE_FILE_H
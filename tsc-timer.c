@@ -0,0 +1,77 @@
+#include "tsc-timer.h"
+#include "utils.h"
+#include <cpuid.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_SEC 1000000000ULL
+#define CALIBRATION_ROUNDS 5
+#define CALIBRATION_NS 20000000ULL // 20ms per round
+#define OVERHEAD_READS 10000
+
+static uint64_t raw_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Reads the clock between two TSC reads, the clock sample is taken at their midpoint
+ */
+static void paired_read(uint64_t* tsc, uint64_t* ns) {
+    uint64_t before = rdtscp64();
+    *ns = raw_ns();
+    uint64_t after = rdtscp64();
+    *tsc = before + (after - before) / 2;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+int tsc_is_invariant(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) return 0;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return 0;
+    return (edx >> 8) & 1;
+}
+
+int tsc_timer_calibrate(tsc_timer_t* timer) {
+    if (!timer) return 0;
+    memset(timer, 0, sizeof(tsc_timer_t));
+    timer->invariant = tsc_is_invariant();
+
+    uint64_t rates[CALIBRATION_ROUNDS];
+    for (int r = 0; r < CALIBRATION_ROUNDS; ++r) {
+        uint64_t tsc_start, ns_start, tsc_end, ns_end;
+        paired_read(&tsc_start, &ns_start);
+        do {
+            paired_read(&tsc_end, &ns_end);
+        } while (ns_end - ns_start < CALIBRATION_NS);
+        rates[r] = (uint64_t)((__uint128_t)(tsc_end - tsc_start) * NS_PER_SEC / (ns_end - ns_start));
+    }
+    qsort(rates, CALIBRATION_ROUNDS, sizeof(uint64_t), compare_u64);
+    timer->tsc_hz = rates[CALIBRATION_ROUNDS / 2];
+
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < OVERHEAD_READS; ++i) {
+        uint64_t a = rdtscp64();
+        uint64_t b = rdtscp64();
+        if (b - a < best) best = b - a;
+    }
+    timer->overhead_cycles = best;
+    return timer->tsc_hz > 0;
+}
+
+uint64_t tsc_cycles_to_ns(const tsc_timer_t* timer, uint64_t cycles) {
+    if (!timer || timer->tsc_hz == 0) return 0;
+    return (uint64_t)((__uint128_t)cycles * NS_PER_SEC / timer->tsc_hz);
+}
+
+uint64_t tsc_ns_to_cycles(const tsc_timer_t* timer, uint64_t ns) {
+    if (!timer) return 0;
+    return (uint64_t)((__uint128_t)ns * timer->tsc_hz / NS_PER_SEC);
+}
@@ -0,0 +1,35 @@
+#ifndef TSC_TIMER_H
+#define TSC_TIMER_H
+#include <stdint.h>
+
+/**
+ * TSC timebase calibrated against CLOCK_MONOTONIC_RAW
+ */
+typedef struct {
+    uint64_t tsc_hz;            // Measured TSC frequency
+    int invariant;              // 1 if CPUID reports an invariant TSC (constant rate, runs in deep C-states)
+    uint64_t overhead_cycles;   // Cost of a back-to-back rdtscp64() pair, subtract it from measured intervals
+} tsc_timer_t;
+
+/**
+ * Check the invariant TSC flag (CPUID 0x80000007, EDX bit 8)
+ */
+int tsc_is_invariant(void);
+
+/**
+ * Measure the TSC frequency and the rdtscp64() overhead. Takes ~100ms.
+ */
+int tsc_timer_calibrate(tsc_timer_t* timer);
+
+/**
+ * Cycles from start to end minus the timer overhead, 0 when the interval was shorter than it
+ */
+static inline uint64_t tsc_elapsed(uint64_t start, uint64_t end, uint64_t overhead) {
+    uint64_t cycles = end - start;
+    return cycles > overhead ? cycles - overhead : 0;
+}
+
+uint64_t tsc_cycles_to_ns(const tsc_timer_t* timer, uint64_t cycles);
+uint64_t tsc_ns_to_cycles(const tsc_timer_t* timer, uint64_t ns);
+
+#endif //TSC_TIMER_H
@@ -1,6 +1,48 @@
+#define _GNU_SOURCE
 #include "utils.h"
 #include <stdio.h>
 #include <string.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * Pins the calling thread to a single core
+ */
+void pin_to_core(int core_id) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core_id, &cpuset);
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0) {
+        perror("sched_setaffinity");
+    }
+}
+
+/**
+ * Opens url in a new browser window, in its own process group, pinned to core
+ * Returns the browser PID, 0 on failure
+ */
+int open_website(const char* url, int core) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork failed");
+        return 0;
+    }
+
+    if (pid == 0) {
+        setpgid(0, 0);
+        // Child process: open browser in incognito mode
+        pin_to_core(core);
+        execlp("google-chrome", "google-chrome",
+              "--new-window",
+              url, NULL);
+        perror("execlp failed"); // if execlp returns
+        exit(EXIT_FAILURE);
+    }
+
+    // Parent continues
+    return pid; // return child PID
+}
 
 void parse_site_name(const char* url, char* site_name, size_t size) {
     const char* www_ptr = strstr(url, "www.");
@@ -37,4 +79,26 @@ void empty_csv(const char* site_name) {
         return;
     }
     fclose(file);
-}
\ No newline at end of file
+}
+
+void empty_trace(const char* site_name) {
+    char trace_path[256];
+    snprintf(trace_path, sizeof(trace_path), "%s.mgtrace", site_name);
+    FILE* file = fopen(trace_path, "w");
+    if (!file) {
+        perror("Failed to open file");
+        return;
+    }
+    fclose(file);
+}
+
+void empty_features(const char* site_name) {
+    char features_path[256];
+    snprintf(features_path, sizeof(features_path), "%s.features.csv", site_name);
+    FILE* file = fopen(features_path, "w");
+    if (!file) {
+        perror("Failed to open file");
+        return;
+    }
+    fclose(file);
+}
@@ -8,7 +8,11 @@ static inline uint64_t rdtscp64() {
     asm volatile ("rdtscp": "=a" (low), "=d" (high) :: "ecx");
     return (((uint64_t)high) << 32) | low;
 }
+void pin_to_core(int core_id);
+int open_website(const char* url, int core);
 void parse_site_name(const char* url, char* site_name, size_t size);
 void empty_csv(const char* site_name);
+void empty_trace(const char* site_name);
+void empty_features(const char* site_name);
 
 #endif //UTILS_H
@@ -0,0 +1,384 @@
+#define _GNU_SOURCE
+#include "prng.h"
+#include "trace-file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/**
+ * Synthetic victim: replays a program of memory-access phases so the probe can be
+ * benchmarked reproducibly, without a browser or a network.
+ *
+ *   victim_generator [--wait] [--seed N] [--repeat N, 0 = forever] [--print]
+ *                    (--phases "<phase>; <phase>; ..." | --program <file> |
+ *                     --from-trace <file.mgtrace> [--round N] [--window-ms N])
+ *
+ * A phase (one per line in a program file, '#' starts a comment):
+ *   <duration_ms> [ws=<bytes>[K|M|G]] [stride=<bytes>] [random=<0..1>]
+ *                 [burst=<bytes>[K|M|G]] [burst_every=<ms>]
+ * Each access either jumps to a random byte of the working set (probability `random`)
+ * or moves `stride` bytes ahead. ws=0 sleeps through the phase. A burst maps,
+ * touches and unmaps `burst` bytes every burst_every ms.
+ * --wait blocks until a line arrives on stdin (victim_gate = stdin).
+ */
+
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+#define LINE_SIZE 64
+#define CHECK_EVERY 4096        // accesses between clock reads
+#define TRACE_LEVELS 16         // working-set quantization of --from-trace
+
+typedef struct {
+    uint64_t duration_ns;
+    size_t ws;
+    size_t stride;
+    double random;
+    size_t burst;
+    uint64_t burst_every_ns;
+} phase_t;
+
+typedef struct {
+    phase_t* phases;
+    size_t num_phases;
+    size_t capacity;
+} program_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+static int parse_size(const char* text, size_t* out) {
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || value < 0) return 0;
+    switch (*end) {
+        case 'K': case 'k': value *= 1024; end++; break;
+        case 'M': case 'm': value *= 1024 * 1024; end++; break;
+        case 'G': case 'g': value *= 1024 * 1024 * 1024; end++; break;
+        default: break;
+    }
+    if (*end != '\0') return 0;
+    *out = (size_t)value;
+    return 1;
+}
+
+static int add_phase(program_t* program, const phase_t* phase) {
+    if (program->num_phases == program->capacity) {
+        size_t capacity = program->capacity ? program->capacity * 2 : 64;
+        phase_t* phases = realloc(program->phases, capacity * sizeof(phase_t));
+        if (!phases) {
+            perror("Failed to allocate phases");
+            return 0;
+        }
+        program->phases = phases;
+        program->capacity = capacity;
+    }
+    program->phases[program->num_phases++] = *phase;
+    return 1;
+}
+
+/**
+ * Parse one phase description. Returns 1 on success, 0 on error, -1 for an empty line
+ */
+static int parse_phase(char* text, phase_t* phase) {
+    memset(phase, 0, sizeof(phase_t));
+    phase->stride = LINE_SIZE;
+    char* save;
+    char* tok = strtok_r(text, " \t\r\n", &save);
+    if (!tok) return -1;
+    char* end;
+    double ms = strtod(tok, &end);
+    if (end == tok || *end != '\0' || ms <= 0) return 0;
+    phase->duration_ns = (uint64_t)(ms * NS_PER_MS);
+
+    while ((tok = strtok_r(NULL, " \t\r\n", &save))) {
+        char* value = strchr(tok, '=');
+        if (!value) return 0;
+        *value++ = '\0';
+        if (strcmp(tok, "ws") == 0) {
+            if (!parse_size(value, &phase->ws)) return 0;
+        } else if (strcmp(tok, "stride") == 0) {
+            if (!parse_size(value, &phase->stride) || phase->stride == 0) return 0;
+        } else if (strcmp(tok, "random") == 0) {
+            phase->random = strtod(value, &end);
+            if (end == value || *end != '\0' || phase->random < 0 || phase->random > 1) return 0;
+        } else if (strcmp(tok, "burst") == 0) {
+            if (!parse_size(value, &phase->burst)) return 0;
+        } else if (strcmp(tok, "burst_every") == 0) {
+            ms = strtod(value, &end);
+            if (end == value || *end != '\0' || ms <= 0) return 0;
+            phase->burst_every_ns = (uint64_t)(ms * NS_PER_MS);
+        } else {
+            return 0;
+        }
+    }
+    if (phase->burst && !phase->burst_every_ns) phase->burst_every_ns = phase->duration_ns;
+    return 1;
+}
+
+/**
+ * Phases separated by sep (';' for --phases, '\n' for program files)
+ */
+static int parse_program(program_t* program, char* text, const char* sep) {
+    char* save;
+    size_t line_no = 0;
+    for (char* line = strtok_r(text, sep, &save); line; line = strtok_r(NULL, sep, &save)) {
+        line_no++;
+        line[strcspn(line, "#")] = '\0';
+        phase_t phase;
+        int ok = parse_phase(line, &phase);
+        if (ok < 0) continue;
+        if (!ok) {
+            fprintf(stderr, "Invalid phase %zu\n", line_no);
+            return 0;
+        }
+        if (!add_phase(program, &phase)) return 0;
+    }
+    return 1;
+}
+
+static int load_program(program_t* program, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror("Failed to open program");
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    if (!text || fread(text, 1, (size_t)size, file) != (size_t)size) {
+        perror("Failed to read program");
+        free(text);
+        fclose(file);
+        return 0;
+    }
+    text[size] = '\0';
+    fclose(file);
+    int ok = parse_program(program, text, "\n");
+    free(text);
+    return ok;
+}
+
+/**
+ * Turn one recorded round into phases: the sweep time above the quietest sample,
+ * averaged over window_ms, becomes a random-access working set of that share of the LLC
+ */
+static int program_from_trace(program_t* program, const char* path, size_t round, uint64_t window_ms) {
+    trace_reader_t tr;
+    if (!trace_map(&tr, path)) return 0;
+    const trace_block_t* block = trace_round(&tr, round);
+    uint64_t* timings = block && block->num_samples ? malloc(block->num_samples * sizeof(uint64_t)) : NULL;
+    if (!timings || !trace_read_column(block, TRACE_COL_TIMINGS, timings)) {
+        fprintf(stderr, "%s has no samples for round %zu\n", path, round);
+        free(timings);
+        trace_unmap(&tr);
+        return 0;
+    }
+    uint64_t* start_tsc = malloc(block->num_samples * sizeof(uint64_t));
+    if (start_tsc && !trace_read_column(block, TRACE_COL_START_TSC, start_tsc)) {
+        free(start_tsc);
+        start_tsc = NULL;
+    }
+    const trace_config_t* config = &tr.header->config;
+    uint64_t window_cycles = config->tsc_hz / 1000 * window_ms;
+    if (window_cycles == 0) window_cycles = 1;
+    size_t n = block->num_samples;
+
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (timings[i] < lo) lo = timings[i];
+        if (timings[i] > hi) hi = timings[i];
+    }
+    double range = hi > lo ? (double)(hi - lo) : 1.0;
+
+    size_t i = 0;
+    size_t level = 0;
+    while (i < n) {
+        uint64_t t0 = start_tsc ? start_tsc[i] : i * tr.header->interval_cycles;
+        double sum = 0;
+        size_t count = 0;
+        for (; i < n; ++i) {
+            uint64_t t = start_tsc ? start_tsc[i] : i * tr.header->interval_cycles;
+            if (t - t0 >= window_cycles) break;
+            sum += (double)(timings[i] - lo) / range;
+            count++;
+        }
+        level = (size_t)(sum / (double)count * TRACE_LEVELS + 0.5);
+
+        // Consecutive windows at the same level extend one phase
+        phase_t* last = program->num_phases ? &program->phases[program->num_phases - 1] : NULL;
+        size_t ws = config->llc_size_bytes / TRACE_LEVELS * level / LINE_SIZE * LINE_SIZE;
+        if (last && last->ws == ws) {
+            last->duration_ns += window_ms * NS_PER_MS;
+            continue;
+        }
+        phase_t phase = {
+            .duration_ns = window_ms * NS_PER_MS,
+            .ws = ws,
+            .stride = LINE_SIZE,
+            .random = 1.0,
+        };
+        if (!add_phase(program, &phase)) {
+            free(timings);
+            free(start_tsc);
+            trace_unmap(&tr);
+            return 0;
+        }
+    }
+    free(timings);
+    free(start_tsc);
+    trace_unmap(&tr);
+    return 1;
+}
+
+static void print_program(const program_t* program) {
+    for (size_t i = 0; i < program->num_phases; ++i) {
+        const phase_t* p = &program->phases[i];
+        printf("%.3f ws=%zu stride=%zu random=%.3f", (double)p->duration_ns / NS_PER_MS, p->ws, p->stride, p->random);
+        if (p->burst) printf(" burst=%zu burst_every=%.3f", p->burst, (double)p->burst_every_ns / NS_PER_MS);
+        printf("\n");
+    }
+}
+
+/**
+ * Map, fault in and drop a region: the allocation burst of a phase
+ */
+static void allocation_burst(size_t bytes) {
+    void* region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) return;
+    memset(region, 1, bytes);
+    munmap(region, bytes);
+}
+
+static void run_phase(uint8_t* buf, const phase_t* phase, prng_t* rng) {
+    uint64_t now = now_ns();
+    const uint64_t deadline = now + phase->duration_ns;
+    if (phase->ws == 0) {
+        struct timespec ts = {(time_t)(phase->duration_ns / NS_PER_SEC), (long)(phase->duration_ns % NS_PER_SEC)};
+        nanosleep(&ts, NULL);
+        return;
+    }
+    // P(random jump) = threshold / 2^64; random just below 1 still rounds up to 2^64, which doesn't fit
+    const double scaled = phase->random * 18446744073709551616.0;
+    const uint64_t threshold = scaled >= 18446744073709551616.0 ? UINT64_MAX : (uint64_t)scaled;
+    const size_t ws = phase->ws;
+    const size_t stride = phase->stride % ws;
+    volatile uint8_t* data = buf;
+    uint64_t next_burst = now + phase->burst_every_ns;
+    size_t pos = 0;
+    while (now < deadline) {
+        for (size_t i = 0; i < CHECK_EVERY; ++i) {
+            if (prng_next(rng) < threshold) {
+                pos = prng_bounded(rng, ws);
+            } else {
+                pos += stride;
+                if (pos >= ws) pos -= ws;
+            }
+            data[pos]++;
+        }
+        now = now_ns();
+        if (phase->burst && now >= next_burst) {
+            allocation_burst(phase->burst);
+            next_burst += phase->burst_every_ns;
+        }
+    }
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [--wait] [--seed N] [--repeat N] [--print]\n"
+                    "          (--phases \"<phase>; ...\" | --program <file> |\n"
+                    "           --from-trace <file.mgtrace> [--round N] [--window-ms N])\n", name);
+}
+
+int main(int argc, char* argv[]) {
+    int wait = 0, print = 0;
+    uint64_t seed = 1;
+    unsigned long repeat = 1;
+    const char* phases = NULL;
+    const char* program_path = NULL;
+    const char* trace_path = NULL;
+    size_t round = 0;
+    uint64_t window_ms = 10;
+    for (int i = 1; i < argc; ++i) {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--wait") == 0) wait = 1;
+        else if (strcmp(argv[i], "--print") == 0) print = 1;
+        else if (strcmp(argv[i], "--seed") == 0 && has_value) seed = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--repeat") == 0 && has_value) repeat = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--phases") == 0 && has_value) phases = argv[++i];
+        else if (strcmp(argv[i], "--program") == 0 && has_value) program_path = argv[++i];
+        else if (strcmp(argv[i], "--from-trace") == 0 && has_value) trace_path = argv[++i];
+        else if (strcmp(argv[i], "--round") == 0 && has_value) round = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--window-ms") == 0 && has_value) window_ms = strtoull(argv[++i], NULL, 0);
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!!phases + !!program_path + !!trace_path != 1 || window_ms == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    program_t program = {0};
+    int ok;
+    if (phases) {
+        char* text = strdup(phases);
+        ok = text && parse_program(&program, text, ";");
+        free(text);
+    } else if (program_path) {
+        ok = load_program(&program, program_path);
+    } else {
+        ok = program_from_trace(&program, trace_path, round, window_ms);
+    }
+    if (!ok || program.num_phases == 0) {
+        fprintf(stderr, "No phases to run.\n");
+        free(program.phases);
+        return EXIT_FAILURE;
+    }
+    if (print) {
+        print_program(&program);
+        free(program.phases);
+        return EXIT_SUCCESS;
+    }
+
+    // One buffer for the largest working set, faulted in before the first phase
+    size_t max_ws = 0;
+    for (size_t i = 0; i < program.num_phases; ++i) {
+        if (program.phases[i].ws > max_ws) max_ws = program.phases[i].ws;
+    }
+    uint8_t* buf = NULL;
+    if (max_ws) {
+        buf = mmap(NULL, max_ws, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (buf == MAP_FAILED) {
+            perror("Failed to map working set");
+            free(program.phases);
+            return EXIT_FAILURE;
+        }
+        memset(buf, 0, max_ws);
+    }
+    prng_t rng;
+    prng_seed(&rng, seed);
+
+    if (wait) {
+        char line[1024];
+        if (!fgets(line, sizeof(line), stdin)) {
+            free(program.phases);
+            return EXIT_SUCCESS; // nobody released us
+        }
+    }
+    for (unsigned long r = 0; repeat == 0 || r < repeat; ++r) {
+        for (size_t i = 0; i < program.num_phases; ++i) {
+            run_phase(buf, &program.phases[i], &rng);
+        }
+    }
+
+    if (buf) munmap(buf, max_ws);
+    free(program.phases);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include "victim-pool.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define RELEASE_TIMEOUT_SEC 10  // give up on an empty pool after this long
+#define RETRY_DELAY_NS 100000000L // back-off after a failed launch
+
+/**
+ * Split command into pool->argv, honouring '...' and "..." quoting
+ */
+static int tokenize(victim_pool_t* pool, const char* command) {
+    pool->args = malloc(strlen(command) + 1);
+    if (!pool->args) {
+        perror("Failed to allocate victim command");
+        return 0;
+    }
+    const char* in = command;
+    char* out = pool->args;
+    size_t argc = 0;
+    for (;;) {
+        while (*in == ' ' || *in == '\t') in++;
+        if (*in == '\0') break;
+        if (argc == VICTIM_MAX_ARGS) {
+            fprintf(stderr, "Victim command has more than %d arguments\n", VICTIM_MAX_ARGS);
+            return 0;
+        }
+        pool->argv[argc++] = out;
+        char quote = 0;
+        for (; *in && (quote || (*in != ' ' && *in != '\t')); in++) {
+            if (!quote && (*in == '\'' || *in == '"')) quote = *in;
+            else if (quote && *in == quote) quote = 0;
+            else *out++ = *in;
+        }
+        *out++ = '\0';
+        if (quote) {
+            fprintf(stderr, "Unterminated quote in victim command\n");
+            return 0;
+        }
+    }
+    pool->argv[argc] = NULL;
+    if (argc == 0) {
+        fprintf(stderr, "Empty victim command\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Child side of a VICTIM_GATE_EXEC victim: wait for the URL line, then exec
+ */
+static void exec_on_release(const victim_pool_t* pool, int gate) {
+    char url[VICTIM_URL_LEN];
+    size_t len = 0;
+    while (len < sizeof(url) - 1) {
+        ssize_t n = read(gate, url + len, sizeof(url) - 1 - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) _exit(0); // the pool went away before releasing us
+        len += (size_t)n;
+        if (url[len - 1] == '\n') break;
+    }
+    url[len && url[len - 1] == '\n' ? len - 1 : len] = '\0';
+
+    char* argv[VICTIM_MAX_ARGS + 1];
+    size_t i = 0;
+    for (; pool->argv[i]; ++i) {
+        argv[i] = strcmp(pool->argv[i], VICTIM_URL_ARG) == 0 ? url : pool->argv[i];
+    }
+    argv[i] = NULL;
+    execvp(argv[0], argv);
+}
+
+/**
+ * Fork one victim in its own process group, pinned and parked on a fresh gate pipe
+ */
+static int launch(const victim_pool_t* pool, victim_t* victim) {
+    int gate[2];
+    if (pipe2(gate, O_CLOEXEC) != 0) {
+        perror("Failed to create gate pipe");
+        return 0;
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork failed");
+        close(gate[0]);
+        close(gate[1]);
+        return 0;
+    }
+
+    if (pid == 0) {
+        setpgid(0, 0);
+        pin_to_core(pool->victim_core);
+        close(gate[1]);
+        if (pool->gate == VICTIM_GATE_STDIN) {
+            dup2(gate[0], STDIN_FILENO);
+            execvp(pool->argv[0], pool->argv);
+        } else {
+            exec_on_release(pool, gate[0]);
+        }
+        perror("execvp failed"); // if execvp returns
+        _exit(127);
+    }
+
+    setpgid(pid, pid); // also from the parent, so kill(-pid) can never miss the group
+    close(gate[0]);
+    victim->pid = pid;
+    victim->gate_fd = gate[1];
+    return 1;
+}
+
+static void reap(const victim_t* victim) {
+    kill(-victim->pid, SIGKILL);
+    close(victim->gate_fd);
+    waitpid(victim->pid, NULL, 0);
+}
+
+static void* refill_main(void* arg) {
+    victim_pool_t* pool = arg;
+    if (pool->helper_core >= 0) pin_to_core(pool->helper_core);
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stop) {
+        if (pool->num_retired > 0) {
+            victim_t victim = pool->retired[--pool->num_retired];
+            pthread_mutex_unlock(&pool->lock);
+            reap(&victim);
+            pthread_mutex_lock(&pool->lock);
+            continue;
+        }
+        // Forking write-protects our page tables, never do it while a round is probing
+        if (pool->num_parked < pool->size && !pool->probing) {
+            pthread_mutex_unlock(&pool->lock);
+            victim_t victim;
+            int ok = launch(pool, &victim);
+            pthread_mutex_lock(&pool->lock);
+            if (ok) {
+                pool->parked[(pool->parked_head + pool->num_parked) % VICTIM_POOL_MAX] = victim;
+                pool->num_parked++;
+                pool->launches++;
+                pthread_cond_broadcast(&pool->cond);
+            } else {
+                pool->failures++;
+                pthread_mutex_unlock(&pool->lock);
+                nanosleep(&(struct timespec){0, RETRY_DELAY_NS}, NULL);
+                pthread_mutex_lock(&pool->lock);
+            }
+            continue;
+        }
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int victim_pool_init(victim_pool_t* pool, const char* command, victim_gate_t gate, size_t size,
+                     int victim_core, int helper_core) {
+    if (!pool || !command || size == 0 || size > VICTIM_POOL_MAX) return 0;
+    memset(pool, 0, sizeof(victim_pool_t));
+    pool->gate = gate;
+    pool->size = size;
+    pool->victim_core = victim_core;
+    pool->helper_core = helper_core;
+    if (!tokenize(pool, command)) {
+        free(pool->args);
+        pool->args = NULL;
+        return 0;
+    }
+    // A victim that died while parked must not kill us on release
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    if (pthread_create(&pool->thread, NULL, refill_main, pool) != 0) {
+        perror("Failed to start victim pool thread");
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->cond);
+        free(pool->args);
+        pool->args = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+int victim_pool_release(victim_pool_t* pool, const char* url, victim_t* victim, uint64_t* release_tsc) {
+    if (!pool || !pool->args || !url || !victim) return 0;
+    char line[VICTIM_URL_LEN];
+    int len = snprintf(line, sizeof(line), "%s\n", url);
+    if (len < 0 || (size_t)len >= sizeof(line)) {
+        fprintf(stderr, "URL too long for the victim gate\n");
+        return 0;
+    }
+
+    // Every parked victim may have died, after that give up
+    for (size_t attempt = 0; attempt <= VICTIM_POOL_MAX; ++attempt) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->num_parked == 0) {
+            pool->waits++;
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += RELEASE_TIMEOUT_SEC;
+            while (pool->num_parked == 0 && !pool->stop) {
+                if (pthread_cond_timedwait(&pool->cond, &pool->lock, &deadline) == ETIMEDOUT) break;
+            }
+            if (pool->num_parked == 0) {
+                pthread_mutex_unlock(&pool->lock);
+                fprintf(stderr, "No victim could be launched.\n");
+                return 0;
+            }
+        }
+        *victim = pool->parked[pool->parked_head];
+        pool->parked_head = (pool->parked_head + 1) % VICTIM_POOL_MAX;
+        pool->num_parked--;
+        pool->probing = 1; // the refill waits for victim_pool_retire()
+        pthread_mutex_unlock(&pool->lock);
+
+        // One write below PIPE_BUF is atomic: the victim sees the whole line at once
+        ssize_t n = write(victim->gate_fd, line, (size_t)len);
+        uint64_t tsc = rdtscp64();
+        if (n == len) {
+            if (release_tsc) *release_tsc = tsc;
+            return 1;
+        }
+        pthread_mutex_lock(&pool->lock);
+        pool->failures++;
+        pthread_mutex_unlock(&pool->lock);
+        victim_pool_retire(pool, victim);
+    }
+    return 0;
+}
+
+void victim_pool_retire(victim_pool_t* pool, const victim_t* victim) {
+    if (!pool || !victim) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->probing = 0;
+    pthread_cond_broadcast(&pool->cond); // reap and refill
+    if (pool->num_retired < VICTIM_POOL_MAX) {
+        pool->retired[pool->num_retired++] = *victim;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    reap(victim); // the helper is far behind, do it here
+}
+
+void victim_pool_free(victim_pool_t* pool) {
+    if (!pool || !pool->args) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_join(pool->thread, NULL);
+
+    for (size_t i = 0; i < pool->num_retired; ++i) reap(&pool->retired[i]);
+    for (size_t i = 0; i < pool->num_parked; ++i) {
+        reap(&pool->parked[(pool->parked_head + i) % VICTIM_POOL_MAX]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->args);
+    memset(pool, 0, sizeof(victim_pool_t));
+}
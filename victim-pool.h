@@ -0,0 +1,79 @@
+#ifndef VICTIM_POOL_H
+#define VICTIM_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define VICTIM_POOL_MAX 16      // parked victims at most
+#define VICTIM_MAX_ARGS 32
+#define VICTIM_URL_LEN 1024
+#define VICTIM_URL_ARG "{url}"  // argument replaced by the URL of the round
+
+/**
+ * Where a parked victim waits for its release
+ */
+typedef enum {
+    VICTIM_GATE_EXEC,           // Forked and pinned, blocked on the gate pipe; execs the command on release,
+                                // so the command's startup still runs inside the probe
+    VICTIM_GATE_STDIN           // Command already running with the gate pipe as stdin; reads the URL line on release
+} victim_gate_t;
+
+typedef struct {
+    pid_t pid;                  // Also the process group, killed as a whole
+    int gate_fd;                // Write end of the gate pipe
+} victim_t;
+
+/**
+ * Keeps launched workloads parked on a gate so a round only pays for a pipe write.
+ * A helper thread refills the pool and reaps retired victims off the probing core.
+ * It never forks from release to retire (fork write-protects our pages), so the pool
+ * is only topped up between rounds; size it for the launches that fit in that gap.
+ * The command is any argv; every argument equal to VICTIM_URL_ARG gets the URL.
+ */
+typedef struct {
+    char* args;                 // Tokenized command, argv points into it
+    char* argv[VICTIM_MAX_ARGS + 1];
+    victim_gate_t gate;
+    int victim_core;            // Core the victims are pinned to
+    int helper_core;            // Core of the refill thread, -1 for no pinning
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    victim_t parked[VICTIM_POOL_MAX];   // FIFO, oldest first
+    size_t parked_head;
+    size_t num_parked;
+    size_t size;                // Victims kept parked
+    victim_t retired[VICTIM_POOL_MAX];
+    size_t num_retired;
+    int stop;
+    int probing;                // Set from a release to its retire: no launches (forks) meanwhile
+    size_t launches;
+    size_t waits;               // Releases that found the pool empty
+    size_t failures;            // Launches or releases that failed
+} victim_pool_t;
+
+/**
+ * Parse the command, start the refill thread and fill the pool with `size` victims
+ */
+int victim_pool_init(victim_pool_t* pool, const char* command, victim_gate_t gate, size_t size,
+                     int victim_core, int helper_core);
+
+/**
+ * Release the oldest parked victim with url. Waits only when the pool is empty.
+ * release_tsc is taken right after the gate opened. Returns 1 on success, 0 on failure
+ */
+int victim_pool_release(victim_pool_t* pool, const char* url, victim_t* victim, uint64_t* release_tsc);
+
+/**
+ * Hand a released victim back once the probe is over; the refill thread kills and
+ * reaps it and only then launches replacements
+ */
+void victim_pool_retire(victim_pool_t* pool, const victim_t* victim);
+
+/**
+ * Stop the refill thread and kill every victim, parked or retired
+ */
+void victim_pool_free(victim_pool_t* pool);
+
+#endif //VICTIM_POOL_H